@@ -1,6 +1,8 @@
 
 using namespace Urho3D;
 
+/// Per-agent controller, driven by the agent's own events - fine for a handful of agents.
+/// For crowds, use CrowdController (one component per scene, which handles every agent in a single pass)
 class AgentController:public LogicComponent
 {
     URHO3D_OBJECT(AgentController, LogicComponent);
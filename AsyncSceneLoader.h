@@ -0,0 +1,190 @@
+#pragma once
+
+#include "SceneFile.h"
+
+using namespace Urho3D;
+
+/// Sent by AsyncSceneLoader when a background scene load has completed,
+/// and the freshly loaded scene is ready to be swapped in (ie by MyApp)
+URHO3D_EVENT(E_ASYNCSCENEREADY, AsyncSceneReady)
+{
+    URHO3D_PARAM(P_SCENE, Scene);           // Scene pointer (the new scene)
+    URHO3D_PARAM(P_FILENAME, FileName);     // String
+}
+
+/// Loads a scene file in the background, without stalling rendering or input.
+/// The file is loaded into a brand new Scene object via Scene::LoadAsync / LoadAsyncXML,
+/// which hands resource loading to the ResourceCache's background (worker) thread
+/// and instantiates nodes a few milliseconds per frame. Progress is displayed in a UI bar.
+/// When loading is complete, E_ASYNCSCENEREADY is sent - the current scene is untouched
+/// until whoever owns it decides to swap in the new one.
+/// Registered as a subsystem by MyApp, so the InGameEditor can use it too.
+class AsyncSceneLoader:public Object
+{
+    URHO3D_OBJECT(AsyncSceneLoader, Object);
+public:
+    AsyncSceneLoader(Context* context):Object(context) { }
+
+    /// Begin loading a scene file (full path), xml or binary by file extension
+    bool Load(const String& fullpath){
+
+        /// Only one background load at a time - abandon any load in progress
+        if(pendingScene_)
+            Cancel();
+
+        SharedPtr<File> file(new File(context_, fullpath, FILE_READ));
+        if(!file->IsOpen()){
+            URHO3D_LOGERROR("AsyncSceneLoader could not open "+fullpath);
+            return false;
+        }
+
+        pendingScene_ = new Scene(context_);
+        pendingScene_->SetAsyncLoadingMs(asyncLoadingMs_);
+        pendingFileName_ = fullpath;
+        packedData_.Clear();
+
+        bool success;
+        if(IsBinarySceneFile(fullpath))
+            success = pendingScene_->LoadAsync(file, LOAD_SCENE_AND_RESOURCES);
+        else{
+            /// Packed buffer attributes (see SceneFile.h) is invisible to Scene::LoadAsyncXML,
+            /// so we pull it out of the document up front, and apply it when the load has finished.
+            /// This costs an extra xml parse - prefer binary scene files for big levels.
+            XMLFile xml(context_);
+            if(xml.Load(*file)){
+                XMLElement root = xml.GetRoot();
+                UnpackBufferAttributes(root, packedData_);
+            }
+            file->Seek(0);
+            success = pendingScene_->LoadAsyncXML(file, LOAD_SCENE_AND_RESOURCES);
+        }
+
+        if(!success){
+            URHO3D_LOGERROR("AsyncSceneLoader failed to start loading "+fullpath);
+            pendingScene_.Reset();
+            return false;
+        }
+
+        SubscribeToEvent(pendingScene_, E_ASYNCLOADPROGRESS, URHO3D_HANDLER(AsyncSceneLoader, HandleLoadProgress));
+        SubscribeToEvent(pendingScene_, E_ASYNCLOADFINISHED, URHO3D_HANDLER(AsyncSceneLoader, HandleLoadFinished));
+
+        CreateProgressBar();
+        URHO3D_LOGINFO("Loading scene in background: "+fullpath);
+        return true;
+    }
+
+    /// Abandon the load in progress (if any)
+    void Cancel(){
+        if(!pendingScene_)
+            return;
+        UnsubscribeFromEvent(pendingScene_, E_ASYNCLOADPROGRESS);
+        UnsubscribeFromEvent(pendingScene_, E_ASYNCLOADFINISHED);
+        pendingScene_->StopAsyncLoading();
+        pendingScene_.Reset();
+        RemoveProgressBar();
+    }
+
+    /// Return whether a background load is in progress
+    bool IsLoading() const { return pendingScene_.NotNull(); }
+
+    /// Set how many milliseconds per frame may be spent instantiating scene nodes
+    void SetAsyncLoadingMs(int ms) { asyncLoadingMs_ = Max(ms, 1); }
+
+private:
+
+    void HandleLoadProgress(StringHash eventType, VariantMap& eventData){
+        using namespace AsyncLoadProgress;
+        float progress = eventData[P_PROGRESS].GetFloat();
+
+        if(progressBar_)
+            progressBar_->SetValue(progress);
+        if(progressText_)
+            progressText_->SetText("Loading "+GetFileNameAndExtension(pendingFileName_)+" ... "+String((int)(progress*100.0f))+"%");
+    }
+
+    void HandleLoadFinished(StringHash eventType, VariantMap& eventData){
+
+        RemoveProgressBar();
+
+        /// This event is sent from inside the new scene's own update,
+        /// so we must keep it alive until the end of the frame, whether or not anyone takes it
+        finishedScene_ = pendingScene_;
+        pendingScene_.Reset();
+        UnsubscribeFromEvent(finishedScene_, E_ASYNCLOADPROGRESS);
+        UnsubscribeFromEvent(finishedScene_, E_ASYNCLOADFINISHED);
+        SubscribeToEvent(E_ENDFRAME, URHO3D_HANDLER(AsyncSceneLoader, HandleEndFrame));
+
+        ApplyBufferAttributes(finishedScene_, packedData_);
+        packedData_.Clear();
+
+        URHO3D_LOGINFO("Finished loading scene in background: "+pendingFileName_);
+
+        using namespace AsyncSceneReady;
+        VariantMap& data = GetEventDataMap();
+        data[P_SCENE]    = finishedScene_.Get();
+        data[P_FILENAME] = pendingFileName_;
+        SendEvent(E_ASYNCSCENEREADY, data);
+    }
+
+    void HandleEndFrame(StringHash eventType, VariantMap& eventData){
+        UnsubscribeFromEvent(E_ENDFRAME);
+        finishedScene_.Reset();
+    }
+
+    /// Create a simple progress display (label plus bar) in the middle of the screen
+    void CreateProgressBar(){
+        RemoveProgressBar();
+
+        /// No graphics, no UI (ie headless mode)
+        if(!GetSubsystem<Graphics>())
+            return;
+
+        UIElement* root = GetSubsystem<UI>()->GetRoot();
+
+        progressWindow_ = new Window(context_);
+        root->AddChild(progressWindow_);
+        progressWindow_->SetStyleAuto();
+        progressWindow_->SetName("SceneLoadProgress");
+        progressWindow_->SetLayout(LM_VERTICAL, 6, IntRect(6, 6, 6, 6));
+        progressWindow_->SetMinWidth(384);
+        progressWindow_->SetAlignment(HA_CENTER, VA_CENTER);
+        progressWindow_->SetPriority(100);  /// Draw on top of editor windows
+
+        progressText_ = new Text(context_);
+        progressWindow_->AddChild(progressText_);
+        progressText_->SetStyleAuto();
+        progressText_->SetText("Loading "+GetFileNameAndExtension(pendingFileName_)+" ...");
+
+        /// A disabled Slider makes a fine progress bar
+        progressBar_ = new Slider(context_);
+        progressWindow_->AddChild(progressBar_);
+        progressBar_->SetStyleAuto();
+        progressBar_->SetMinHeight(24);
+        progressBar_->SetRange(1.0f);
+        progressBar_->SetValue(0.0f);
+        progressBar_->SetEnabled(false);
+    }
+
+    void RemoveProgressBar(){
+        if(progressWindow_)
+            progressWindow_->Remove();
+        progressWindow_.Reset();
+        progressText_.Reset();
+        progressBar_.Reset();
+    }
+
+    /// The scene being loaded (not yet visible to anybody else)
+    SharedPtr<Scene> pendingScene_;
+    /// The scene that just finished loading, kept alive until the end of the frame
+    SharedPtr<Scene> finishedScene_;
+    /// Full path of the scene file being loaded
+    String pendingFileName_;
+    /// Buffer attributes unpacked from an xml scene file, applied when loading has finished
+    Vector<PackedBufferData> packedData_;
+    /// Node instantiation budget per frame
+    int asyncLoadingMs_ = 5;
+
+    WeakPtr<Window> progressWindow_;
+    WeakPtr<Text>   progressText_;
+    WeakPtr<Slider> progressBar_;
+};
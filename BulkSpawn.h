@@ -0,0 +1,72 @@
+#pragma once
+
+using namespace Urho3D;
+
+/// Bulk creation of StaticModel nodes that share one model and material (procedural level population).
+/// Creating them one at a time (CreateChild, SetPosition, SetRotation, SetScale, CreateComponent, SetModel...)
+/// dirties each node's transform several times, and queues an Octree reinsertion on every model/transform change.
+/// Here each node is fully built while still detached from the scene, where none of that has any listeners:
+/// its transform is set in one go (a single dirty mark), and its model and material are set before it has an octant.
+/// Only then is it attached, which registers it with the scene and inserts its drawable into the Octree.
+/// Note that insertion still happens once per node, as it is attached (Urho has no batched Octree insertion) -
+/// what we save is the transform dirtying and the reinsertions, not the insertions themselves.
+class BulkSpawn
+{
+public:
+    struct SpawnItem{
+        String      name_;
+        Vector3     position_;
+        Quaternion  rotation_;
+        Vector3     scale_;
+        bool        occluder_;
+    };
+
+    void Reserve(unsigned count) { items_.Reserve(count); }
+
+    void Add(const String& name, const Vector3& position, const Quaternion& rotation=Quaternion::IDENTITY, const Vector3& scale=Vector3::ONE, bool occluder=false){
+        SpawnItem item;
+        item.name_     = name;
+        item.position_ = position;
+        item.rotation_ = rotation;
+        item.scale_    = scale;
+        item.occluder_ = occluder;
+        items_.Push(item);
+    }
+
+    unsigned GetNumItems() const { return items_.Size(); }
+    void Clear() { items_.Clear(); }
+
+    /// Create one child of parent, with a StaticModel, per item - in item order.
+    /// Optionally returns the new nodes. Returns the number of nodes created.
+    unsigned Spawn(Node* parent, Model* model, Material* material, PODVector<Node*>* spawned=nullptr) const {
+        if(!parent)
+            return 0;
+        if(spawned)
+            spawned->Reserve(spawned->Size() + items_.Size());
+
+        Context* context = parent->GetContext();
+        for(unsigned i=0; i<items_.Size(); i++){
+            const SpawnItem& item = items_[i];
+
+            /// Build the node while it is detached (no scene, no octree, no listeners)
+            SharedPtr<Node> node(new Node(context));
+            node->SetName(item.name_);
+            node->SetTransform(item.position_, item.rotation_, item.scale_);
+
+            auto* object = node->CreateComponent<StaticModel>();
+            object->SetModel(model);
+            object->SetMaterial(material);
+            if(item.occluder_)
+                object->SetOccluder(true);
+
+            /// Attaching assigns the node and component IDs, and inserts the drawable into the octree
+            parent->AddChild(node);
+            if(spawned)
+                spawned->Push(node);
+        }
+        return items_.Size();
+    }
+
+private:
+    Vector<SpawnItem> items_;
+};
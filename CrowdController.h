@@ -0,0 +1,315 @@
+#pragma once
+
+using namespace Urho3D;
+
+/// Grid cell of a position, packed into 64 bits (21 bits per axis) - for hashing nearby positions together
+inline unsigned long long GetGridCellKey(const Vector3& position, float cellSize){
+    cellSize = Max(cellSize, M_EPSILON);
+    unsigned long long x = (unsigned long long)(FloorToInt(position.x_ / cellSize) + (1 << 20)) & 0x1fffff;
+    unsigned long long y = (unsigned long long)(FloorToInt(position.y_ / cellSize) + (1 << 20)) & 0x1fffff;
+    unsigned long long z = (unsigned long long)(FloorToInt(position.z_ / cellSize) + (1 << 20)) & 0x1fffff;
+    return (x << 42) | (y << 21) | z;
+}
+
+/// Crowd-scale replacement for AgentController: one component (on the scene) looks after every CrowdAgent.
+/// AgentController subscribes each agent to three events - with thousands of agents, the per-event
+/// VariantMap dispatch costs far more than the work done. Instead, after the crowd has updated, we walk
+/// all agents in one pass over packed arrays (struct-of-arrays: component ID, agent state, target state, arrived),
+/// compare against last frame to find what changed, and apply the same behaviour as AgentController:
+/// - an agent which has arrived at its target is brought to a stop
+/// - an agent with an invalid state (ie spawned on the side of a box) is moved to the nearest point on the navmesh,
+///   searching a larger area - see "Off-mesh recovery" below
+/// - state changes are optionally logged
+/// The agent list is maintained from the scene's node / component added and removed events, not rebuilt every frame.
+///
+/// Off-mesh recovery: invalid agents are not recovered on the spot, they join a recovery queue.
+/// Each frame we resolve as many queued agents as fit in a time budget (at least one), so a wave of agents
+/// spawning off the mesh is spread over a few frames instead of spiking one.
+/// Nearest-point answers are cached on a coarse grid for a short while: agents spawning close together
+/// (ie on the same box side) share one navmesh query. The cache is dropped whenever the navmesh changes.
+class CrowdController:public LogicComponent
+{
+    URHO3D_OBJECT(CrowdController, LogicComponent);
+public:
+    static void RegisterObject(Context* context){
+        context->RegisterFactory<CrowdController>();
+        URHO3D_ATTRIBUTE("Log State Changes", bool, logStateChanges_, false, AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Recovery Extents", Vector3, recoveryExtents_, Vector3(5.0f, 5.0f, 5.0f), AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Recovery Budget Ms", float, recoveryBudgetMs_, 1.0f, AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Recovery Cell Size", float, recoveryCellSize_, 1.0f, AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Recovery Cache Time", float, recoveryCacheTime_, 2.0f, AM_DEFAULT);
+    }
+
+    CrowdController(Context* context):LogicComponent(context) {
+        SetUpdateEventMask(USE_POSTUPDATE);
+    }
+
+    virtual void DelayedStart(){
+        Scene* scene = GetScene();
+        crowd_ = scene->GetComponent<CrowdManager>();
+
+        /// Pick up the agents which already exist, then track additions and removals
+        ClearAgents();
+        PODVector<CrowdAgent*> agents;
+        scene->GetComponents<CrowdAgent>(agents, true);
+        for(unsigned i=0; i<agents.Size(); i++)
+            AddAgent(agents[i]);
+
+        SubscribeToEvent(scene, E_NODEADDED,        URHO3D_HANDLER(CrowdController, HandleNodeAdded));
+        SubscribeToEvent(scene, E_COMPONENTADDED,   URHO3D_HANDLER(CrowdController, HandleComponentAdded));
+        SubscribeToEvent(scene, E_COMPONENTREMOVED, URHO3D_HANDLER(CrowdController, HandleComponentRemoved));
+
+        /// Cached recovery answers are only good for the navmesh they came from
+        SubscribeToEvent(E_NAVIGATION_MESH_REBUILT, URHO3D_HANDLER(CrowdController, HandleNavigationChanged));
+        SubscribeToEvent(E_NAVIGATION_AREA_REBUILT, URHO3D_HANDLER(CrowdController, HandleNavigationChanged));
+        SubscribeToEvent(E_NAVIGATION_TILE_ADDED,   URHO3D_HANDLER(CrowdController, HandleNavigationChanged));
+        SubscribeToEvent(E_NAVIGATION_TILE_REMOVED, URHO3D_HANDLER(CrowdController, HandleNavigationChanged));
+    }
+
+    /// The crowd has been updated (during the scene subsystem update) - process every agent in one pass
+    virtual void PostUpdate(float dT){
+        Scene* scene = GetScene();
+        time_ += dT;
+
+        for(unsigned i=0; i<agents_.Size(); i++){
+            CrowdAgent* agent = agents_[i];
+
+            /// Agents whose node was removed (no per-component event is sent for those) are dropped here
+            if(!agent || agent->GetScene()!=scene){
+                RemoveAgentAt(i--);
+                continue;
+            }
+            if(!agent->IsEnabledEffective())
+                continue;
+
+            unsigned char agentState  = (unsigned char)agent->GetAgentState();
+            unsigned char targetState = (unsigned char)agent->GetTargetState();
+            unsigned char arrived     = agent->HasArrived() ? 1 : 0;
+
+            /// Arrival: stop where we are
+            if(arrived && !arrived_[i])
+                agent->SetTargetVelocity(Vector3::ZERO);
+
+            /// Failure: queue the agent for recovery
+            if(agentState==CA_STATE_INVALID && !recoveryQueued_.Contains(agent)){
+                QueuedAgent queued;
+                queued.agent_ = agent;
+                queued.key_   = agent;
+                recoveryQueued_.Insert(agent);
+                recoveryQueue_.Push(queued);
+            }
+
+            if(logStateChanges_ && (agentState!=agentStates_[i] || targetState!=targetStates_[i]))
+                URHO3D_LOGINFO("Agent "+String(ids_[i])+" AgentState: "+GetAgentStateName((CrowdAgentState)agentState)+
+                               ", TargetState: "+GetTargetStateName((CrowdAgentTargetState)targetState));
+
+            agentStates_[i]  = agentState;
+            targetStates_[i] = targetState;
+            arrived_[i]      = arrived;
+        }
+
+        ProcessRecoveryQueue();
+    }
+
+    unsigned GetNumAgents() const { return agents_.Size(); }
+    unsigned GetNumQueuedForRecovery() const { return recoveryQueue_.Size(); }
+
+private:
+
+    /// Queued for recovery - the key stays valid for removal from the set, even if the agent has gone
+    struct QueuedAgent{
+        WeakPtr<CrowdAgent> agent_;
+        CrowdAgent*         key_;
+    };
+
+    /// Cached nearest-point answer for one grid cell
+    struct RecoveryCacheEntry{
+        Vector3 point_;
+        float   time_;
+    };
+
+    /// Move queued agents to the nearest point on the navmesh (searching a larger area), within our time budget
+    void ProcessRecoveryQueue(){
+        if(recoveryQueue_.Empty())
+            return;
+        NavigationMesh* navmesh = crowd_ ? crowd_->GetNavigationMesh() : nullptr;
+        if(!navmesh)
+            return;
+
+        HiresTimer timer;
+        long long budget = (long long)(recoveryBudgetMs_ * 1000.0f);
+        unsigned processed = 0;
+
+        while(processed < recoveryQueue_.Size()){
+            /// Always make some progress, however small the budget
+            if(processed && timer.GetUSec(false) >= budget)
+                break;
+
+            const QueuedAgent& queued = recoveryQueue_[processed++];
+            recoveryQueued_.Erase(queued.key_);
+            CrowdAgent* agent = queued.agent_;
+            if(!agent || agent->GetScene()!=GetScene() || agent->GetAgentState()!=CA_STATE_INVALID)
+                continue;
+
+            /// The CrowdAgent resets its state when its node is moved
+            Node* node = agent->GetNode();
+            node->SetWorldPosition(FindRecoveryPoint(navmesh, node->GetWorldPosition()));
+        }
+
+        recoveryQueue_.Erase(0, processed);
+    }
+
+    /// Nearest navmesh point, from the cache if a recent query was made in the same cell
+    Vector3 FindRecoveryPoint(NavigationMesh* navmesh, const Vector3& position){
+        unsigned long long key = GetGridCellKey(position, recoveryCellSize_);
+        HashMap<unsigned long long, RecoveryCacheEntry>::Iterator i = recoveryCache_.Find(key);
+        if(i!=recoveryCache_.End() && time_ - i->second_.time_ < recoveryCacheTime_)
+            return i->second_.point_;
+
+        RecoveryCacheEntry& entry = recoveryCache_[key];
+        entry.point_ = navmesh->FindNearestPoint(position, recoveryExtents_);
+        entry.time_  = time_;
+
+        /// Keep the cache small - it only needs to remember the latest wave of spawns
+        if(recoveryCache_.Size() > MAX_RECOVERY_CACHE)
+            PruneRecoveryCache();
+        return entry.point_;
+    }
+
+    void PruneRecoveryCache(){
+        for(HashMap<unsigned long long, RecoveryCacheEntry>::Iterator i = recoveryCache_.Begin(); i!=recoveryCache_.End();){
+            if(time_ - i->second_.time_ >= recoveryCacheTime_)
+                i = recoveryCache_.Erase(i);
+            else
+                ++i;
+        }
+    }
+
+    void HandleNavigationChanged(StringHash eventType, VariantMap& eventData){
+        recoveryCache_.Clear();
+    }
+
+    void AddAgent(CrowdAgent* agent){
+        HashMap<unsigned, unsigned>::ConstIterator slot = agentSlots_.Find(agent->GetID());
+        if(slot!=agentSlots_.End()){
+            if(agents_[slot->second_].Get()==agent)
+                return;
+            /// The ID of an agent whose node went away (not yet pruned) has been reused - drop the old one
+            RemoveAgentAt(slot->second_);
+        }
+        agentSlots_[agent->GetID()] = agents_.Size();
+        agents_.Push(agent);
+        ids_.Push(agent->GetID());
+        agentStates_.Push((unsigned char)agent->GetAgentState());
+        targetStates_.Push((unsigned char)agent->GetTargetState());
+        arrived_.Push(agent->HasArrived() ? 1 : 0);
+    }
+
+    void RemoveAgent(CrowdAgent* agent){
+        HashMap<unsigned, unsigned>::ConstIterator slot = agentSlots_.Find(agent->GetID());
+        if(slot!=agentSlots_.End() && agents_[slot->second_].Get()==agent)
+            RemoveAgentAt(slot->second_);
+    }
+
+    /// Removal moves the last agent into the freed slot
+    void RemoveAgentAt(unsigned i){
+        unsigned last = agents_.Size()-1;
+        agentSlots_.Erase(ids_[i]);
+        if(i!=last)
+            agentSlots_[ids_[last]] = i;
+        agents_[i]       = agents_[last];
+        ids_[i]          = ids_[last];
+        agentStates_[i]  = agentStates_[last];
+        targetStates_[i] = targetStates_[last];
+        arrived_[i]      = arrived_[last];
+        agents_.Pop();
+        ids_.Pop();
+        agentStates_.Pop();
+        targetStates_.Pop();
+        arrived_.Pop();
+    }
+
+    void ClearAgents(){
+        agentSlots_.Clear();
+        agents_.Clear();
+        ids_.Clear();
+        agentStates_.Clear();
+        targetStates_.Clear();
+        arrived_.Clear();
+    }
+
+    /// A node (ie restored by undo, or a prefab) was attached with its components already in place
+    void HandleNodeAdded(StringHash eventType, VariantMap& eventData){
+        using namespace NodeAdded;
+        Node* node = static_cast<Node*>(eventData[P_NODE].GetPtr());
+        if(!node)
+            return;
+        PODVector<CrowdAgent*> agents;
+        node->GetComponents<CrowdAgent>(agents, true);
+        for(unsigned i=0; i<agents.Size(); i++)
+            AddAgent(agents[i]);
+    }
+
+    void HandleComponentAdded(StringHash eventType, VariantMap& eventData){
+        using namespace ComponentAdded;
+        Component* comp = static_cast<Component*>(eventData[P_COMPONENT].GetPtr());
+        if(comp && comp->GetType()==CrowdAgent::GetTypeStatic())
+            AddAgent(static_cast<CrowdAgent*>(comp));
+        else if(comp && comp->GetType()==CrowdManager::GetTypeStatic())
+            crowd_ = static_cast<CrowdManager*>(comp);
+    }
+
+    void HandleComponentRemoved(StringHash eventType, VariantMap& eventData){
+        using namespace ComponentRemoved;
+        Component* comp = static_cast<Component*>(eventData[P_COMPONENT].GetPtr());
+        if(comp && comp->GetType()==CrowdAgent::GetTypeStatic())
+            RemoveAgent(static_cast<CrowdAgent*>(comp));
+    }
+
+    static String GetAgentStateName(CrowdAgentState state){
+        switch(state){
+            case CA_STATE_INVALID: return "Invalid";
+            case CA_STATE_WALKING: return "Walking";
+            case CA_STATE_OFFMESH: return "OffMesh";
+        }
+        return String::EMPTY;
+    }
+
+    static String GetTargetStateName(CrowdAgentTargetState state){
+        switch(state){
+            case CA_TARGET_NONE:             return "None";
+            case CA_TARGET_FAILED:           return "Failed";
+            case CA_TARGET_VALID:            return "Valid";
+            case CA_TARGET_REQUESTING:       return "Requesting";
+            case CA_TARGET_WAITINGFORQUEUE:  return "WaitingForQueue";
+            case CA_TARGET_WAITINGFORPATH:   return "WaitingForPath";
+            case CA_TARGET_VELOCITY:         return "Velocity";
+        }
+        return String::EMPTY;
+    }
+
+    /// Cache entries we hold before pruning expired ones
+    static const unsigned MAX_RECOVERY_CACHE = 1024;
+
+    WeakPtr<CrowdManager> crowd_;
+
+    bool    logStateChanges_=false;
+    Vector3 recoveryExtents_=Vector3(5.0f, 5.0f, 5.0f);
+    float   recoveryBudgetMs_=1.0f;     /// Time per frame spent recovering queued agents
+    float   recoveryCellSize_=1.0f;     /// Grid cell size for cached nearest-point answers
+    float   recoveryCacheTime_=2.0f;    /// How long (seconds) a cached answer stays good
+    float   time_=0.0f;
+
+    /// Invalid agents waiting for recovery (the set stops an agent being queued twice)
+    Vector<QueuedAgent>             recoveryQueue_;
+    HashSet<CrowdAgent*>            recoveryQueued_;
+    HashMap<unsigned long long, RecoveryCacheEntry> recoveryCache_;
+
+    /// Agents, struct-of-arrays (the same index in each array)
+    Vector<WeakPtr<CrowdAgent> > agents_;
+    PODVector<unsigned>         ids_;           /// Component IDs (for logging, and for anyone reading the arrays)
+    PODVector<unsigned char>    agentStates_;   /// CrowdAgentState as of last frame
+    PODVector<unsigned char>    targetStates_;  /// CrowdAgentTargetState as of last frame
+    PODVector<unsigned char>    arrived_;       /// Whether the agent had arrived as of last frame
+    HashMap<unsigned, unsigned> agentSlots_;    /// Component ID -> index in the arrays
+};
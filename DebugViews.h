@@ -0,0 +1,108 @@
+#pragma once
+
+#include <Urho3D/ThirdParty/Detour/DetourNavMesh.h>
+
+using namespace Urho3D;
+
+/// View-culled debug drawing for big scenes, used by the InGameEditor.
+/// Octree::DrawDebugGeometry and NavigationMesh::DrawDebugGeometry emit everything there is
+/// (the navmesh draws every polygon of every tile), which swamps the DebugRenderer on large maps.
+/// These versions only emit what lies inside the camera frustum, and within a maximum distance of the camera.
+
+/// Distance from a point to the nearest point of a box (zero if inside)
+inline float DistanceToBox(const BoundingBox& box, const Vector3& point){
+    Vector3 nearest(Clamp(point.x_, box.min_.x_, box.max_.x_),
+                    Clamp(point.y_, box.min_.y_, box.max_.y_),
+                    Clamp(point.z_, box.min_.z_, box.max_.z_));
+    return (point - nearest).Length();
+}
+
+/// Draw the bounding boxes of non-empty octants which are visible and near enough
+inline void DrawOctantsCulled(Octant* octant, DebugRenderer* debug, const Frustum& frustum, const Vector3& eye, float maxDistance, bool depthTest){
+    if(octant->IsEmpty())
+        return;
+    const BoundingBox& box = octant->GetWorldBoundingBox();
+    if(frustum.IsInsideFast(box)==OUTSIDE || DistanceToBox(box, eye) > maxDistance)
+        return;
+
+    debug->AddBoundingBox(box, Color(0.25f, 0.25f, 0.25f), depthTest);
+    for(unsigned i=0; i<NUM_OCTANTS; i++){
+        Octant* child = octant->GetChild(i);
+        if(child)
+            DrawOctantsCulled(child, debug, frustum, eye, maxDistance, depthTest);
+    }
+}
+
+inline void DrawOctreeCulled(Octree* octree, DebugRenderer* debug, Camera* camera, float maxDistance, bool depthTest){
+    if(!octree || !debug || !camera)
+        return;
+    DrawOctantsCulled(octree, debug, camera->GetFrustum(), camera->GetNode()->GetWorldPosition(), maxDistance, depthTest);
+}
+
+/// The Detour navmesh is protected - but a pointer-to-member formed through a derived class
+/// may be applied to any NavigationMesh
+struct NavigationMeshAccess:public NavigationMesh
+{
+    static dtNavMesh* Get(NavigationMesh* navmesh){
+        return navmesh->*(&NavigationMeshAccess::navMesh_);
+    }
+};
+
+/// Draw the polygon outlines of navmesh tiles which are visible and near enough.
+/// Only the tiles under the visible area are visited (not every tile of the navmesh)
+inline void DrawNavigationMeshCulled(NavigationMesh* navmesh, DebugRenderer* debug, Camera* camera, float maxDistance, bool depthTest){
+    if(!navmesh || !debug || !camera)
+        return;
+    const dtNavMesh* dt = NavigationMeshAccess::Get(navmesh);
+    if(!dt)
+        return;
+
+    const Frustum& frustum = camera->GetFrustum();
+    Vector3 eye = camera->GetNode()->GetWorldPosition();
+    const Matrix3x4& transform = navmesh->GetNode()->GetWorldTransform();
+    Matrix3x4 inverse = transform.Inverse();
+
+    /// Visible area: the part of the frustum within maxDistance of the camera, in navmesh space
+    /// (NavigationMesh::GetTileIndex wants world positions, so work out the local tile range ourselves)
+    BoundingBox visible(frustum);
+    visible.Clip(BoundingBox(eye - Vector3::ONE * maxDistance, eye + Vector3::ONE * maxDistance));
+    visible = visible.Transformed(inverse);
+    const BoundingBox& bounds = navmesh->GetBoundingBox();
+    float tileEdge = navmesh->GetTileSize() * navmesh->GetCellSize();
+    IntVector2 numTiles = navmesh->GetNumTiles();
+    if(!numTiles.x_ || !numTiles.y_ || tileEdge<=0.0f)
+        return;
+    IntVector2 first(FloorToInt((visible.min_.x_ - bounds.min_.x_) / tileEdge), FloorToInt((visible.min_.z_ - bounds.min_.z_) / tileEdge));
+    IntVector2 last (FloorToInt((visible.max_.x_ - bounds.min_.x_) / tileEdge), FloorToInt((visible.max_.z_ - bounds.min_.z_) / tileEdge));
+    first = IntVector2(Clamp(first.x_, 0, numTiles.x_-1), Clamp(first.y_, 0, numTiles.y_-1));
+    last  = IntVector2(Clamp(last.x_,  0, numTiles.x_-1), Clamp(last.y_,  0, numTiles.y_-1));
+
+    static const int MAX_LAYERS = 32;
+    const dtMeshTile* tiles[MAX_LAYERS];
+
+    for(int z=first.y_; z<=last.y_; z++){
+        for(int x=first.x_; x<=last.x_; x++){
+            int numLayers = dt->getTilesAt(x, z, tiles, MAX_LAYERS);
+            for(int t=0; t<numLayers; t++){
+                const dtMeshTile* tile = tiles[t];
+                if(!tile->header)
+                    continue;
+
+                BoundingBox bounds(*reinterpret_cast<const Vector3*>(tile->header->bmin), *reinterpret_cast<const Vector3*>(tile->header->bmax));
+                bounds = bounds.Transformed(transform);
+                if(frustum.IsInsideFast(bounds)==OUTSIDE || DistanceToBox(bounds, eye) > maxDistance)
+                    continue;
+
+                for(int i=0; i<tile->header->polyCount; i++){
+                    const dtPoly* poly = tile->polys + i;
+                    for(unsigned j=0; j<poly->vertCount; j++){
+                        debug->AddLine(
+                            transform * *reinterpret_cast<const Vector3*>(&tile->verts[poly->verts[j] * 3]),
+                            transform * *reinterpret_cast<const Vector3*>(&tile->verts[poly->verts[(j + 1) % poly->vertCount] * 3]),
+                            Color::YELLOW, depthTest);
+                    }
+                }
+            }
+        }
+    }
+}
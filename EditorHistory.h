@@ -0,0 +1,354 @@
+#pragma once
+
+using namespace Urho3D;
+
+/// Undo / Redo history for the InGameEditor.
+/// We never store copies of the scene: attribute and node var edits are recorded as deltas
+/// (object ID, attribute index or var name, old value, new value), so undoing an edit costs
+/// as much as the edit itself. Creating or deleting a node or component stores a binary snapshot
+/// of just that node (with its components and children) or component - the same data Urho writes
+/// to binary scene files, restored with the original IDs so that older history entries remain valid.
+/// Memory is bounded: the oldest entries are dropped when we exceed the entry or byte budget.
+class EditorHistory:public Object
+{
+    URHO3D_OBJECT(EditorHistory, Object);
+
+    /// Kinds of edit
+    enum EditType{
+        EDIT_ATTRIBUTES,
+        EDIT_CREATE_NODE,
+        EDIT_DELETE_NODE,
+        EDIT_CREATE_COMPONENT,
+        EDIT_DELETE_COMPONENT
+    };
+
+    /// A single changed value
+    struct AttributeDelta{
+        unsigned    objectID_;      /// Node or Component ID
+        bool        isNode_;
+        unsigned    index_;         /// Attribute index, or M_MAX_UNSIGNED for node vars
+        StringHash  var_;           /// Node var name (node vars only)
+        Variant     oldValue_;
+        Variant     newValue_;
+    };
+
+    /// One undoable step - a batch edit is a single step, however many objects it touched
+    struct EditRecord{
+        EditType    type_;
+        Vector<AttributeDelta>      deltas_;        /// EDIT_ATTRIBUTES
+        unsigned    parentID_=0;                    /// Parent node (node records) or owner node (component records)
+        unsigned    objectID_=0;                    /// Created / deleted node or component
+        PODVector<unsigned char>    snapshot_;      /// Binary copy of the deleted object (taken before it goes away)
+        unsigned    memory_=0;                      /// Approximate memory use
+    };
+
+public:
+    EditorHistory(Context* context):Object(context) { }
+
+    /// Set the history budget: maximum number of undo steps, and approximate memory
+    void SetLimits(unsigned maxEntries, unsigned maxBytes){
+        maxEntries_ = Max(maxEntries, 1U);
+        maxBytes_   = maxBytes;
+        Trim();
+    }
+
+    /// Forget everything (ie a different scene was loaded)
+    void Clear(){
+        undo_.Clear();
+        redo_.Clear();
+        pending_.deltas_.Clear();
+        memory_=0;
+    }
+
+    bool CanUndo() const { return !undo_.Empty(); }
+    bool CanRedo() const { return !redo_.Empty(); }
+    unsigned GetMemoryUse() const { return memory_; }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////
+    /// Recording - attribute and var changes are collected between BeginEdit and EndEdit
+
+    void BeginEdit(){
+        pending_.deltas_.Clear();
+    }
+
+    void AddAttributeDelta(Serializable* object, unsigned index, const Variant& oldValue, const Variant& newValue){
+        if(oldValue==newValue)
+            return;
+        AttributeDelta delta;
+        delta.isNode_   = object->IsInstanceOf<Node>();
+        delta.objectID_ = delta.isNode_ ? static_cast<Node*>(object)->GetID() : static_cast<Component*>(object)->GetID();
+        delta.index_    = index;
+        delta.oldValue_ = oldValue;
+        delta.newValue_ = newValue;
+        pending_.deltas_.Push(delta);
+    }
+
+    void AddVarDelta(Node* node, StringHash var, const Variant& oldValue, const Variant& newValue){
+        if(oldValue==newValue)
+            return;
+        AttributeDelta delta;
+        delta.isNode_   = true;
+        delta.objectID_ = node->GetID();
+        delta.index_    = M_MAX_UNSIGNED;
+        delta.var_      = var;
+        delta.oldValue_ = oldValue;
+        delta.newValue_ = newValue;
+        pending_.deltas_.Push(delta);
+    }
+
+    void EndEdit(){
+        if(pending_.deltas_.Empty())
+            return;
+        EditRecord record;
+        record.type_ = EDIT_ATTRIBUTES;
+        record.deltas_.Swap(pending_.deltas_);
+        Push(record);
+    }
+
+    /// Call after a node has been created
+    void RecordCreateNode(Node* node){
+        if(!node || !node->GetParent())
+            return;
+        EditRecord record;
+        record.type_     = EDIT_CREATE_NODE;
+        record.parentID_ = node->GetParent()->GetID();
+        record.objectID_ = node->GetID();
+        Push(record);
+    }
+
+    /// Call before a node is deleted
+    void RecordDeleteNode(Node* node){
+        if(!node || !node->GetParent())
+            return;
+        EditRecord record;
+        record.type_     = EDIT_DELETE_NODE;
+        record.parentID_ = node->GetParent()->GetID();
+        record.objectID_ = node->GetID();
+        SnapshotNode(node, record.snapshot_);
+        Push(record);
+    }
+
+    /// Call after a component has been created
+    void RecordCreateComponent(Component* comp){
+        if(!comp || !comp->GetNode())
+            return;
+        EditRecord record;
+        record.type_     = EDIT_CREATE_COMPONENT;
+        record.parentID_ = comp->GetNode()->GetID();
+        record.objectID_ = comp->GetID();
+        Push(record);
+    }
+
+    /// Call before a component is deleted
+    void RecordDeleteComponent(Component* comp){
+        if(!comp || !comp->GetNode())
+            return;
+        EditRecord record;
+        record.type_     = EDIT_DELETE_COMPONENT;
+        record.parentID_ = comp->GetNode()->GetID();
+        record.objectID_ = comp->GetID();
+        SnapshotComponent(comp, record.snapshot_);
+        Push(record);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////
+    /// Undo / Redo - return false if there was nothing to do, or the step could not be applied
+
+    bool Undo(Scene* scene){
+        if(undo_.Empty())
+            return false;
+        EditRecord record = undo_.Back();
+        undo_.Pop();
+        memory_ -= record.memory_;
+
+        bool success = Apply(scene, record, false);
+        record.memory_ = EstimateMemory(record);
+        memory_ += record.memory_;
+        redo_.Push(record);
+        return success;
+    }
+
+    bool Redo(Scene* scene){
+        if(redo_.Empty())
+            return false;
+        EditRecord record = redo_.Back();
+        redo_.Pop();
+        memory_ -= record.memory_;
+
+        bool success = Apply(scene, record, true);
+        record.memory_ = EstimateMemory(record);
+        memory_ += record.memory_;
+        undo_.Push(record);
+        return success;
+    }
+
+private:
+
+    /// Add a new step - this invalidates anything we could have redone
+    void Push(EditRecord& record){
+        for(unsigned i=0; i<redo_.Size(); i++)
+            memory_ -= redo_[i].memory_;
+        redo_.Clear();
+
+        record.memory_ = EstimateMemory(record);
+        memory_ += record.memory_;
+        undo_.Push(record);
+        Trim();
+    }
+
+    /// Drop the oldest steps until we're within budget (we always keep the latest step)
+    void Trim(){
+        unsigned drop=0;
+        while(undo_.Size()-drop > 1 && (undo_.Size()-drop > maxEntries_ || memory_ > maxBytes_)){
+            memory_ -= undo_[drop].memory_;
+            drop++;
+        }
+        if(drop)
+            undo_.Erase(0, drop);
+    }
+
+    /// Apply a step forwards (redo) or backwards (undo)
+    bool Apply(Scene* scene, EditRecord& record, bool forward){
+        switch(record.type_){
+            case EDIT_ATTRIBUTES:{
+                bool success=true;
+                for(unsigned i=0; i<record.deltas_.Size(); i++){
+                    /// Undo in reverse order, in case one batch touched the same value twice
+                    const AttributeDelta& delta = record.deltas_[forward ? i : record.deltas_.Size()-1-i];
+                    const Variant& value = forward ? delta.newValue_ : delta.oldValue_;
+                    Serializable* object = delta.isNode_ ? static_cast<Serializable*>(scene->GetNode(delta.objectID_))
+                                                         : static_cast<Serializable*>(scene->GetComponent(delta.objectID_));
+                    if(!object){
+                        success=false;
+                        continue;
+                    }
+                    if(delta.index_==M_MAX_UNSIGNED)
+                        static_cast<Node*>(object)->SetVar(delta.var_, value);
+                    else
+                        object->SetAttribute(delta.index_, value);
+                }
+                return success;
+            }
+            case EDIT_CREATE_NODE:
+            case EDIT_DELETE_NODE:
+                /// Undoing a create is a delete, and vice versa
+                if((record.type_==EDIT_CREATE_NODE)==forward)
+                    return RestoreNode(scene, record);
+                return RemoveNode(scene, record);
+
+            case EDIT_CREATE_COMPONENT:
+            case EDIT_DELETE_COMPONENT:
+                if((record.type_==EDIT_CREATE_COMPONENT)==forward)
+                    return RestoreComponent(scene, record);
+                return RemoveComponent(scene, record);
+        }
+        return false;
+    }
+
+    /// Snapshot and remove a node
+    bool RemoveNode(Scene* scene, EditRecord& record){
+        Node* node = scene->GetNode(record.objectID_);
+        if(!node)
+            return false;
+        SnapshotNode(node, record.snapshot_);
+        node->Remove();
+        return true;
+    }
+
+    /// Recreate a node (with its original ID) from its snapshot
+    bool RestoreNode(Scene* scene, EditRecord& record){
+        Node* parent = scene->GetNode(record.parentID_);
+        if(!parent || record.snapshot_.Empty() || scene->GetNode(record.objectID_))
+            return false;
+        Node* node = parent->CreateChild(record.objectID_, record.objectID_ < FIRST_LOCAL_ID ? REPLICATED : LOCAL);
+        MemoryBuffer buffer(record.snapshot_);
+        return node->Load(buffer);
+    }
+
+    /// Snapshot and remove a component
+    bool RemoveComponent(Scene* scene, EditRecord& record){
+        Component* comp = scene->GetComponent(record.objectID_);
+        if(!comp)
+            return false;
+        SnapshotComponent(comp, record.snapshot_);
+        comp->Remove();
+        return true;
+    }
+
+    /// Recreate a component (with its original ID) from its snapshot
+    bool RestoreComponent(Scene* scene, EditRecord& record){
+        Node* node = scene->GetNode(record.parentID_);
+        if(!node || record.snapshot_.Empty() || scene->GetComponent(record.objectID_))
+            return false;
+
+        /// Component::Save writes type and ID, then the attributes (which is what Component::Load reads)
+        MemoryBuffer buffer(record.snapshot_);
+        StringHash type = buffer.ReadStringHash();
+        unsigned id = buffer.ReadUInt();
+        Component* comp = node->CreateComponent(type, id < FIRST_LOCAL_ID ? REPLICATED : LOCAL, id);
+        if(!comp || !comp->Load(buffer))
+            return false;
+        comp->ApplyAttributes();
+        return true;
+    }
+
+    static void SnapshotNode(Node* node, PODVector<unsigned char>& dest){
+        VectorBuffer buffer;
+        node->Save(buffer);
+        dest = buffer.GetBuffer();
+    }
+
+    static void SnapshotComponent(Component* comp, PODVector<unsigned char>& dest){
+        VectorBuffer buffer;
+        comp->Save(buffer);
+        dest = buffer.GetBuffer();
+    }
+
+    /// Approximate memory used by a history step
+    static unsigned EstimateMemory(const EditRecord& record){
+        unsigned size = sizeof(EditRecord) + record.snapshot_.Size();
+        for(unsigned i=0; i<record.deltas_.Size(); i++)
+            size += sizeof(AttributeDelta) + EstimateMemory(record.deltas_[i].oldValue_) + EstimateMemory(record.deltas_[i].newValue_);
+        return size;
+    }
+
+    /// Heap memory owned by a Variant (beyond the Variant itself)
+    static unsigned EstimateMemory(const Variant& value){
+        switch(value.GetType()){
+            case VAR_STRING:            return value.GetString().Length();
+            case VAR_BUFFER:            return value.GetBuffer().Size();
+            case VAR_RESOURCEREF:       return value.GetResourceRef().name_.Length();
+            case VAR_RESOURCEREFLIST:{
+                const StringVector& names = value.GetResourceRefList().names_;
+                unsigned size=0;
+                for(unsigned i=0; i<names.Size(); i++)
+                    size += sizeof(String) + names[i].Length();
+                return size;
+            }
+            case VAR_STRINGVECTOR:{
+                const StringVector& strings = value.GetStringVector();
+                unsigned size=0;
+                for(unsigned i=0; i<strings.Size(); i++)
+                    size += sizeof(String) + strings[i].Length();
+                return size;
+            }
+            case VAR_VARIANTVECTOR:{
+                const VariantVector& values = value.GetVariantVector();
+                unsigned size=0;
+                for(unsigned i=0; i<values.Size(); i++)
+                    size += sizeof(Variant) + EstimateMemory(values[i]);
+                return size;
+            }
+            default:                    return 0;
+        }
+    }
+
+    Vector<EditRecord> undo_;
+    Vector<EditRecord> redo_;
+    /// Attribute deltas collected since BeginEdit
+    EditRecord pending_;
+
+    unsigned memory_=0;
+    unsigned maxEntries_=100;
+    unsigned maxBytes_=8*1024*1024;
+};
@@ -0,0 +1,211 @@
+#pragma once
+
+using namespace Urho3D;
+
+/// View mask bit reserved for editor overlays - editor queries (picking, marquee) leave it out,
+/// so the overlay geometry can't be picked
+static const unsigned EDITOR_OVERLAY_VIEWMASK = 0x80000000;
+
+/// Editor queries see everything except our overlays
+static const unsigned EDITOR_QUERY_VIEWMASK = ~EDITOR_OVERLAY_VIEWMASK;
+
+/// Cheap running hash (FNV-1a) of everything an overlay's content depends on
+class OverlayKey
+{
+public:
+    template <class T> void Add(const T& value){
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+        for(unsigned i=0; i<sizeof(T); i++)
+            hash_ = (hash_ ^ bytes[i]) * 16777619U;
+    }
+    /// Bounding boxes may contain padding (SIMD builds) - hash just the corners
+    void Add(const BoundingBox& box){
+        Add(box.min_);
+        Add(box.max_);
+    }
+    unsigned Get() const { return hash_; }
+private:
+    unsigned hash_=2166136261U;
+};
+
+/// Retained line overlay for the InGameEditor (axes, gizmo, cursor, selection boxes).
+/// Unlike the DebugRenderer, which is refilled and re-uploaded every frame, our lines live in a
+/// CustomGeometry (on a temporary scene node), so its vertex buffer stays on the GPU between frames.
+/// Each frame the editor computes a key from the state the overlay depends on (camera, selection, cursor...):
+/// only when the key changes do we rebuild the lines - on a static frame, the overlay costs one draw call.
+/// There are two layers: lines which are hidden behind scene geometry (depth tested), and lines which are always on top.
+class EditorOverlay:public Object
+{
+    URHO3D_OBJECT(EditorOverlay, Object);
+
+    enum OverlayLayer{
+        LAYER_DEPTHTEST,
+        LAYER_ONTOP,
+        NUM_LAYERS
+    };
+
+    struct OverlayVertex{
+        Vector3 position_;
+        Color   color_;
+    };
+
+public:
+    EditorOverlay(Context* context):Object(context) { }
+
+    /// Create the overlay node and geometry in a scene (reusing any previous instance, ie after a reload)
+    void Create(Scene* scene){
+        node_ = scene->GetChild("EditorOverlay", false);
+        if(!node_){
+            node_ = scene->CreateChild("EditorOverlay", LOCAL);
+            node_->SetTemporary(true);      /// Never saved with the scene
+        }
+
+        geometry_ = node_->GetOrCreateComponent<CustomGeometry>(LOCAL);
+        geometry_->SetTemporary(true);
+        geometry_->SetViewMask(EDITOR_OVERLAY_VIEWMASK);
+        geometry_->SetNumGeometries(NUM_LAYERS);
+        geometry_->SetMaterial(LAYER_DEPTHTEST, CreateLineMaterial(true));
+        geometry_->SetMaterial(LAYER_ONTOP,     CreateLineMaterial(false));
+
+        key_=0;
+        building_=false;
+    }
+
+    /// Start a frame: returns true if the overlay must be rebuilt (the key has changed) -
+    /// in which case, add the lines, then call EndRebuild
+    bool BeginRebuild(unsigned key){
+        if(!geometry_ || (key==key_ && !dirty_))
+            return false;
+        key_ = key;
+        dirty_ = false;
+        building_ = true;
+        for(unsigned i=0; i<NUM_LAYERS; i++)
+            lines_[i].Clear();
+        return true;
+    }
+
+    /// Upload the new lines
+    void EndRebuild(){
+        if(!building_)
+            return;
+        building_ = false;
+
+        for(unsigned i=0; i<NUM_LAYERS; i++){
+            geometry_->BeginGeometry(i, LINE_LIST);
+            const PODVector<OverlayVertex>& lines = lines_[i];
+            for(unsigned j=0; j<lines.Size(); j++){
+                geometry_->DefineVertex(lines[j].position_);
+                geometry_->DefineColor(lines[j].color_);
+            }
+        }
+        geometry_->Commit();
+    }
+
+    /// Force a rebuild on the next frame
+    void MarkDirty() { dirty_=true; }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////
+    /// Line primitives (only valid between BeginRebuild and EndRebuild) - same arguments as the DebugRenderer's
+
+    void AddLine(const Vector3& start, const Vector3& end, const Color& color, bool depthTest=true){
+        PODVector<OverlayVertex>& lines = lines_[depthTest ? LAYER_DEPTHTEST : LAYER_ONTOP];
+        OverlayVertex v;
+        v.color_ = color;
+        v.position_ = start;
+        lines.Push(v);
+        v.position_ = end;
+        lines.Push(v);
+    }
+
+    void AddCircle(const Vector3& center, const Vector3& normal, float radius, const Color& color, int steps=64, bool depthTest=true){
+        Quaternion orientation;
+        orientation.FromRotationTo(Vector3::UP, normal.Normalized());
+        Vector3 p = orientation * Vector3(radius, 0, 0) + center;
+        for(int i=1; i<=steps; i++){
+            float angle = (float)i / (float)steps * 360.0f;
+            Vector3 v = orientation * Vector3(radius * Cos(angle), 0, radius * Sin(angle)) + center;
+            AddLine(p, v, color, depthTest);
+            p = v;
+        }
+    }
+
+    /// Cross aligned to the given orientation
+    void AddCross(const Vector3& center, const Quaternion& rotation, float size, const Color& color, bool depthTest=true){
+        float half = size * 0.5f;
+        AddLine(center - rotation * Vector3(half, 0, 0), center + rotation * Vector3(half, 0, 0), color, depthTest);
+        AddLine(center - rotation * Vector3(0, half, 0), center + rotation * Vector3(0, half, 0), color, depthTest);
+        AddLine(center - rotation * Vector3(0, 0, half), center + rotation * Vector3(0, 0, half), color, depthTest);
+    }
+
+    void AddBoundingBox(const BoundingBox& box, const Color& color, bool depthTest=true){
+        const Vector3& min = box.min_;
+        const Vector3& max = box.max_;
+        Vector3 v1(max.x_, min.y_, min.z_);
+        Vector3 v2(max.x_, max.y_, min.z_);
+        Vector3 v3(min.x_, max.y_, min.z_);
+        Vector3 v4(min.x_, min.y_, max.z_);
+        Vector3 v5(max.x_, min.y_, max.z_);
+        Vector3 v6(min.x_, max.y_, max.z_);
+
+        AddLine(min, v1, color, depthTest);
+        AddLine(v1, v2, color, depthTest);
+        AddLine(v2, v3, color, depthTest);
+        AddLine(v3, min, color, depthTest);
+        AddLine(v4, v5, color, depthTest);
+        AddLine(v5, max, color, depthTest);
+        AddLine(max, v6, color, depthTest);
+        AddLine(v6, v4, color, depthTest);
+        AddLine(min, v4, color, depthTest);
+        AddLine(v1, v5, color, depthTest);
+        AddLine(v2, max, color, depthTest);
+        AddLine(v3, v6, color, depthTest);
+    }
+
+    /// Sphere outline (three great circles)
+    void AddSphere(const Sphere& sphere, const Color& color, bool depthTest=true){
+        AddCircle(sphere.center_, Vector3::RIGHT,   sphere.radius_, color, 32, depthTest);
+        AddCircle(sphere.center_, Vector3::UP,      sphere.radius_, color, 32, depthTest);
+        AddCircle(sphere.center_, Vector3::FORWARD, sphere.radius_, color, 32, depthTest);
+    }
+
+    /// Local axes of a node (red, green, blue), of the given world length
+    void AddMajorAxes(Node* node, float length, bool depthTest=true){
+        if(!node)
+            return;
+        Vector3 pos = node->GetWorldPosition();
+        const Vector3& scale = node->GetWorldScale();
+        AddLine(pos, node->LocalToWorld(Vector3::RIGHT   * length / scale.x_), Color(1, 0, 0, 1), depthTest);
+        AddLine(pos, node->LocalToWorld(Vector3::UP      * length / scale.y_), Color(0, 1, 0, 1), depthTest);
+        AddLine(pos, node->LocalToWorld(Vector3::FORWARD * length / scale.z_), Color(0, 0, 1, 1), depthTest);
+    }
+
+private:
+
+    /// Unlit vertex-colored lines, drawn after opaque geometry, optionally on top of everything
+    SharedPtr<Material> CreateLineMaterial(bool depthTest){
+        SharedPtr<Technique> technique(new Technique(context_));
+        Pass* pass = technique->CreatePass("alpha");
+        pass->SetVertexShader("Basic");
+        pass->SetPixelShader("Basic");
+        pass->SetVertexShaderDefines("VERTEXCOLOR");
+        pass->SetPixelShaderDefines("VERTEXCOLOR");
+        pass->SetBlendMode(BLEND_ALPHA);
+        pass->SetDepthWrite(false);
+        pass->SetDepthTestMode(depthTest ? CMP_LESSEQUAL : CMP_ALWAYS);
+
+        SharedPtr<Material> material(new Material(context_));
+        material->SetTechnique(0, technique);
+        material->SetCullMode(CULL_NONE);
+        return material;
+    }
+
+    WeakPtr<Node>           node_;
+    WeakPtr<CustomGeometry> geometry_;
+
+    /// Lines of each layer, as vertex pairs (kept between rebuilds, so their memory is reused)
+    PODVector<OverlayVertex> lines_[NUM_LAYERS];
+
+    unsigned    key_=0;
+    bool        dirty_=true;
+    bool        building_=false;
+};
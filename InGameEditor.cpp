@@ -6,6 +6,9 @@
 
 
 #include "InGameEditor.h"
+#include "SceneFile.h"
+#include "AsyncSceneLoader.h"
+#include "PrefabCache.h"
 
 
     void InGameEditor::RegisterObject(Context* context){
@@ -19,9 +22,24 @@
         URHO3D_ATTRIBUTE("hideVars", bool, hideVars, true, AM_DEFAULT);
         URHO3D_ATTRIBUTE("hideNodeAttribs", bool, hideNodeAttribs, true, AM_DEFAULT);
         URHO3D_ATTRIBUTE("hideComponentAttribs", bool, hideComponentAttribs, true, AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Virtual Hierarchy", bool, useVirtualHierarchy_, false, AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Inspector Live Watch", bool, liveWatch_, false, AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Live Watch Interval", float, liveWatchInterval_, 0.1f, AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Pick Refresh Interval", float, pickRefreshInterval_, 0.25f, AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Two-Phase Picking", bool, useTwoPhasePicking_, true, AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Pick Candidates", int, pickCandidates_, 8, AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Undo Levels", int, undoLevels_, 100, AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Undo Memory KB", int, undoMemoryKB_, 8192, AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Draw Octree", bool, drawOctree_, false, AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Draw NavMesh", bool, drawNavMesh_, false, AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Debug Draw Distance", float, debugDrawDistance_, 100.0f, AM_DEFAULT);
     }
 
-    InGameEditor::InGameEditor(Context* context):LogicComponent(context){}
+    InGameEditor::InGameEditor(Context* context):LogicComponent(context),
+        history_(new EditorHistory(context)),
+        gizmo_(new TransformGizmo(context)),
+        overlay_(new EditorOverlay(context)),
+        modelBVHs_(new ModelBVHCache()){}
 
 
 
@@ -38,6 +56,7 @@
 
        SubscribeToEvent(E_POSTRENDERUPDATE,  URHO3D_HANDLER(InGameEditor,HandlePostRenderUpdate));    // Post-Render Update
        debugDraw_ = scene->GetOrCreateComponent<DebugRenderer>();
+       overlay_->Create(scene);
 
                /// Locate our camera node in the reloaded scene
                 auto* camnode = scene->GetChild("Camera Node");
@@ -89,8 +108,9 @@
             uiRoot_->AddChild(MainMenu_);
 
             CreateMainMenuItem("Project", {"New","Load","Save"},"bleh");
-            CreateMainMenuItem("Scene",   {"New Scene","Load Scene","Save Scene"},"blehh");
-            CreateMainMenuItem("Tools",   {"Hierarchy","Inspector", "Transform","NavMesh"},"blehh");
+            CreateMainMenuItem("Scene",   {"New Scene","Load Scene","Save Scene","Convert Scene"},"blehh");
+            CreateMainMenuItem("Edit",    {"Undo","Redo"},"blehh");
+            CreateMainMenuItem("Tools",   {"Hierarchy","Hierarchy Mode","Inspector", "Transform","Octree","NavMesh"},"blehh");
             CreateMainMenuItem("Prefab",  {"Load Prefab","Save Prefab"},"meh");
         }
 
@@ -102,6 +122,9 @@
         list = MainMenu_->GetChild("Scene",true)->GetChild("DropDownList",true);
         SubscribeToEvent(list, "ItemSelected", URHO3D_HANDLER(InGameEditor, HandleUIDropDownItemSelected));
 
+        list = MainMenu_->GetChild("Edit",true)->GetChild("DropDownList",true);
+        SubscribeToEvent(list, "ItemSelected", URHO3D_HANDLER(InGameEditor, HandleUIDropDownItemSelected));
+
         list = MainMenu_->GetChild("Tools",true)->GetChild("DropDownList",true);
         SubscribeToEvent(list, "ItemSelected", URHO3D_HANDLER(InGameEditor, HandleUIDropDownItemSelected));
 
@@ -117,12 +140,24 @@
         /// Create the Scene Hierarchy Editor window
         CreateHierarchyWindow();
 
-        /// Populate the ListView with existing scene nodes
-        RebuildHierarchy( (ListView*)HierarchyWindow_->GetChild("ListContent",false), GetNode()->GetScene());
+        /// Big scenes get the virtualized hierarchy view by default
+        if(!useVirtualHierarchy_ && GetScene()->GetNumChildren(true)>VIRTUAL_HIERARCHY_THRESHOLD)
+            useVirtualHierarchy_=true;
+
+        /// Populate the hierarchy view with existing scene nodes
+        ApplyHierarchyMode();
+
+        /// From here on, the hierarchy is kept up to date by scene events, so only the affected rows change
+        SubscribeToEvent(scene, E_NODEADDED,        URHO3D_HANDLER(InGameEditor, HandleSceneNodeAdded));
+        SubscribeToEvent(scene, E_NODEREMOVED,      URHO3D_HANDLER(InGameEditor, HandleSceneNodeRemoved));
+        SubscribeToEvent(scene, E_COMPONENTADDED,   URHO3D_HANDLER(InGameEditor, HandleSceneComponentAdded));
+        SubscribeToEvent(scene, E_COMPONENTREMOVED, URHO3D_HANDLER(InGameEditor, HandleSceneComponentRemoved));
+        SubscribeToEvent(scene, E_NODENAMECHANGED,  URHO3D_HANDLER(InGameEditor, HandleSceneNodeNameChanged));
 
         /// Subscribe to receive notification of "TreeView Element Clicked"
         list = HierarchyWindow_->GetChild("ListContent",true);
         SubscribeToEvent(list, E_ITEMCLICKED, URHO3D_HANDLER(InGameEditor, HandleListViewItemClicked));
+        SubscribeToEvent(virtualHierarchy_->GetListView(), E_ITEMCLICKED, URHO3D_HANDLER(InGameEditor, HandleListViewItemClicked));
 
         auto* btn = HierarchyWindow_->GetChild("CloseButton",true);
         SubscribeToEvent(btn, E_RELEASED,     URHO3D_HANDLER(InGameEditor, HandleClosePressed));
@@ -155,7 +190,7 @@
         SubscribeToEvent(InspectorWindow_, E_DRAGMOVE, URHO3D_HANDLER(InGameEditor, HandleWindowDragMove));
 
         /// Populating the Inspector will ensure all relevant UI events are hooked up
-        RebuildInspector();
+        UpdateInspector();
         InspectorWindow_->SetVisible(InspectorIsVisible);
 
 
@@ -176,6 +211,12 @@
         SubscribeToEvent(E_MOUSEBUTTONDOWN,   URHO3D_HANDLER(InGameEditor, HandleMouseButtonDown));     // MouseButton Down
         SubscribeToEvent(E_MOUSEBUTTONUP,     URHO3D_HANDLER(InGameEditor, HandleMouseButtonUp));       // MouseButton Up
 
+        /// Undo / Redo budget
+        history_->SetLimits((unsigned)Max(undoLevels_, 1), (unsigned)Max(undoMemoryKB_, 0) * 1024);
+
+        /// One subscription serves every Inspector field (see fieldBindings_)
+        SubscribeToEvent(E_TEXTFINISHED,      URHO3D_HANDLER(InGameEditor, HandleTextEditFinished));
+
 
 
         ///////////////////////////////////////////
@@ -239,6 +280,19 @@
 
     /// When the menu is hidden, we can move the camera
     void InGameEditor::Update(float dT){
+        /// Catch up with scene changes in the virtualized hierarchy (at most once per frame)
+        if(useVirtualHierarchy_ && virtualHierarchy_)
+            virtualHierarchy_->Update();
+
+        /// Live Watch: refresh the values shown in the Inspector at a throttled rate (10 Hz by default)
+        if(liveWatch_ && InspectorIsVisible){
+            liveWatchTimer_ += dT;
+            if(liveWatchTimer_ >= liveWatchInterval_){
+                liveWatchTimer_ = 0;
+                RefreshInspectorValues();
+            }
+        }
+
         if(!MainMenu_->IsVisible())
             MoveCamera(dT);
 
@@ -247,61 +301,67 @@
 
         /// TODO: Move this code into a mousebutton event handler
 
-        /// Mouse Pick-Ray: cast a ray into scene
-        /// from position of mouse cursor on camera nearplane
-        /// and return the first drawable object that ray hits
-        Vector3 hitPos, hitNormal;
-        Drawable* hitGeom=nullptr;
-
-        auto* graphics = GetSubsystem<Graphics>();
-        auto* camera = EditorCameraNode_->GetComponent<Camera>();
         auto* ui = GetSubsystem<UI>();
 
         IntVector2 pos = ui->GetCursorPosition();
+
+        /// Marquee selection rectangle follows the cursor, even across UI windows
+        UpdateMarquee(pos);
+
+        /// The cursor crosshair is hidden while the cursor is over UI (its pick ray is not kept up to date there)
+        cursorOverUI_ = ui->GetElementAt(pos, true)!=nullptr;
+
+        /// Keep the transform gizmo on the primary selection
+        auto* camera = EditorCameraNode_->GetComponent<Camera>();
+        gizmo_->SetLocalSpace(useLocalSpace);
+        gizmo_->Place(selectedNode_, camera);
+
+        /// While dragging the gizmo, all we need is the ray - no picking, no selection changes
+        if(gizmo_->IsDragging()){
+            auto* graphics = GetSubsystem<Graphics>();
+            gizmo_->Drag(camera->GetScreenRay((float)pos.x_ / graphics->GetWidth(), (float)pos.y_ / graphics->GetHeight()));
+            return;
+        }
+
         // Check the cursor is visible and there is no UI element in front of the cursor
-        if (ui->GetElementAt(pos, true))
+        if (cursorOverUI_)
             return;
 
-        Ray cameraRay = camera->GetScreenRay((float)pos.x_ / graphics->GetWidth(), (float)pos.y_ / graphics->GetHeight());
+        /// Mouse Pick-Ray: cast a ray into scene
+        /// from position of mouse cursor on camera nearplane
+        /// and return the first drawable object that ray hits
+        /// (the result is cached - see UpdatePick)
+        UpdatePick(pos, dT);
+        Drawable* hitGeom = pick_.drawable_;
+        Vector3 hitNormal = pick_.hitNormal_;
 
+        /// Gizmo handles take priority over scene objects
+        if(gizmo_->UpdateHover(pick_.ray_)!=TransformGizmo::HANDLE_NONE)
+            return;
 
-        bool hit = Raycast(cameraRay, 50.0f, hitPos, hitNormal, hitGeom );
-        if(hit){
+        if(hitGeom){
            //URHO3D_LOGINFO(hitGeom->GetTypeName()+" : "+hitGeom->GetNode()->GetName());
            /// Set the "current candidate object" - the object under the cursor right now
            candidateDrawable_ = hitGeom;
            candidateNormal_ = hitNormal;
 
             /// If left mouse is down, set the "currently selected object" - the object we care to manipulate
+            /// (unless we're dragging a marquee). Hold Shift to add it to the selection set.
             auto* input=GetSubsystem<Input>();
-            if(input->GetMouseButtonDown(MOUSEB_LEFT)){
+            if(input->GetMouseButtonDown(MOUSEB_LEFT) && !marqueeActive_){
                 selectedDrawable_ = hitGeom;
                 selectedComponent_=selectedDrawable_;
                 selectedNode_=selectedComponent_->GetNode();
-                RebuildInspector();
-                RebuildHierarchy( (ListView*)HierarchyWindow_->GetChild("ListContent",false), GetScene());
+                if(input->GetQualifierDown(QUAL_SHIFT)){
+                    if(!selection_.Contains(WeakPtr<Node>(selectedNode_)))
+                        selection_.Push(selectedNode_);
+                }else
+                    SelectSingle();
+                UpdateInspector();
+                SelectHierarchyItem();
             }
         }
 
-        if(selectedDrawable_){
-
-                const BoundingBox& bb = selectedDrawable_->GetWorldBoundingBox();
-                Sphere sphere(bb);
-
-                float r = sphere.radius_;
-
-                float d = cameraRay.HitDistance(sphere);
-
-                Vector3 hitpos = cameraRay.origin_ + cameraRay.direction_ * d;
-
-                float dd = hitpos.DistanceToPoint(cameraRay.origin_);
-
-                if(dd == sphere.radius_){
-                    debugDraw_->AddCircle(hitpos, (hitpos - bb.Center() ).Normalized(),0.1f,Color::RED, 24);
-                    debugDraw_->AddLine(hitpos, bb.Center(), Color::MAGENTA, false);
-                }
-        }
-
     }
 
 
@@ -327,7 +387,6 @@
         lineEdit->SetText(text);
         lineEdit->SetCursorPosition(0); /// If we don't do this, our default text won't be visible :(
         container->AddChild(lineEdit);
-        SubscribeToEvent( E_TEXTFINISHED, URHO3D_HANDLER(InGameEditor, HandleTextEditFinished));
         return lineEdit;
     }
 
@@ -341,7 +400,6 @@
         lineEdit->SetCursorPosition(0); /// If we don't do this, our default text won't be visible :(
         lineEdit->SetInternal(true);
         container->AddItem(lineEdit);
-        SubscribeToEvent(lineEdit, E_TEXTFINISHED, URHO3D_HANDLER(InGameEditor, HandleTextEditFinished));
         return lineEdit;
     }
 
@@ -606,255 +664,121 @@
     }
 
 
+    /// Register an Inspector field as editing (part of) a Serializable attribute
+    /// part = -1 for the whole value, or 0..3 for the x,y,z,w of a vector or quaternion
+    void InGameEditor::BindAttributeField(UIElement* element, Serializable* source, const AttributeInfo* info, int part){
+        const Vector<AttributeInfo>* attribs = source->GetAttributes();
+
+        FieldBinding binding;
+        binding.source_ = source;
+        binding.index_  = M_MAX_UNSIGNED;
+        binding.type_   = info->type_;
+        binding.part_   = part;
+
+        /// The AttributeInfo we're given lives in the source's attribute list, so we can work out its index
+        if(attribs && !attribs->Empty() && info>=&attribs->Front() && info<=&attribs->Back())
+            binding.index_ = (unsigned)(info - &attribs->Front());
+        else if(attribs){
+            for(unsigned i=0; i<attribs->Size(); i++)
+                if(attribs->At(i).name_==info->name_){
+                    binding.index_=i;
+                    break;
+                }
+        }
+
+        if(binding.index_!=M_MAX_UNSIGNED)
+            fieldBindings_[element]=binding;
+    }
+
+    /// Register an Inspector field as editing (part of) a node var
+    void InGameEditor::BindVarField(UIElement* element, Node* node, StringHash var, VariantType type, int part){
+        FieldBinding binding;
+        binding.source_ = node;
+        binding.index_  = M_MAX_UNSIGNED;
+        binding.var_    = var;
+        binding.type_   = type;
+        binding.part_   = part;
+        fieldBindings_[element]=binding;
+    }
+
+    /// Utility: read an attribute value, whether it's stored directly or via accessor
+    static Variant GetAttributeValue(Serializable* source, const AttributeInfo* info){
+        Variant value;
+        source->OnGetAttribute(*info, value);
+        return value;
+    }
+
     void InGameEditor::AddAttribute_Vector2(Serializable* source, UIElement* container, const AttributeInfo* info){
         UIElement* row = AddRow(container);
         Button* btn = AddButton(row, info->name_+": ", Color::GREEN);
 
-        if(info->ptr_){
-        const Vector2* pos = (Vector2*)info->ptr_;
-        LineEdit* ed = AddLineEdit(row,"X", String(pos->x_));
-                    ed->SetVar("Type",VAR_VECTOR2);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-
-        ed=AddLineEdit(row,"Y", String(pos->y_));
-                    ed->SetVar("Type",VAR_VECTOR2);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-        }else{
-
-         Variant vpos;
-         info->accessor_->Get(source, vpos);
-         Vector2 pos = vpos.GetVector2();
-         LineEdit* ed = AddLineEdit(row,"X", String(pos.x_));
-                    ed->SetVar("Type",VAR_VECTOR2);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-         ed = AddLineEdit(row,"Y", String(pos.y_));
-                    ed->SetVar("Type",VAR_VECTOR2);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-        }
+        Vector2 pos = GetAttributeValue(source, info).GetVector2();
+        BindAttributeField(AddLineEdit(row,"X", String(pos.x_)), source, info, 0);
+        BindAttributeField(AddLineEdit(row,"Y", String(pos.y_)), source, info, 1);
     }
 
     void InGameEditor::AddAttribute_Vector3(Serializable* source, UIElement* container, const AttributeInfo* info){
         UIElement* row = AddRow(container);
         Button* btn = AddButton(row, info->name_+": ", Color::GREEN);
 
-        if(info->ptr_){
-        const Vector3* pos = (Vector3*)info->ptr_;
-        LineEdit* ed = AddLineEdit(row,"X", String(pos->x_));
-                    ed->SetVar("Type",VAR_VECTOR3);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-
-        ed=AddLineEdit(row,"Y", String(pos->y_));
-                    ed->SetVar("Type",VAR_VECTOR3);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-
-        ed = AddLineEdit(row,"Z", String(pos->z_));
-                    ed->SetVar("Type",VAR_VECTOR3);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-        }else{
-
-         Variant vpos;
-         info->accessor_->Get(source, vpos);
-         Vector3 pos = vpos.GetVector3();
-         LineEdit* ed = AddLineEdit(row,"X", String(pos.x_));
-                    ed->SetVar("Type",VAR_VECTOR3);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-         ed = AddLineEdit(row,"Y", String(pos.y_));
-                    ed->SetVar("Type",VAR_VECTOR3);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-         ed = AddLineEdit(row,"Z", String(pos.z_));
-                    ed->SetVar("Type",VAR_VECTOR3);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-        }
+        Vector3 pos = GetAttributeValue(source, info).GetVector3();
+        BindAttributeField(AddLineEdit(row,"X", String(pos.x_)), source, info, 0);
+        BindAttributeField(AddLineEdit(row,"Y", String(pos.y_)), source, info, 1);
+        BindAttributeField(AddLineEdit(row,"Z", String(pos.z_)), source, info, 2);
     }
 
     void InGameEditor::AddAttribute_Vector4(Serializable* source, UIElement* container, const AttributeInfo* info){
         UIElement* row = AddRow(container);
         Button* btn = AddButton(row, info->name_+": ", Color::GREEN);
 
-        if(info->ptr_){
-        const Vector4* pos = (Vector4*)info->ptr_;
-        LineEdit* ed = AddLineEdit(row,"X", String(pos->x_));
-                    ed->SetVar("Type",VAR_VECTOR4);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-
-        ed=AddLineEdit(row,"Y", String(pos->y_));
-                    ed->SetVar("Type",VAR_VECTOR4);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-
-        ed = AddLineEdit(row,"Z", String(pos->z_));
-                    ed->SetVar("Type",VAR_VECTOR4);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-        ed = AddLineEdit(row,"W", String(pos->w_));
-                    ed->SetVar("Type",VAR_VECTOR4);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-        }else{
-
-         Variant vpos;
-         info->accessor_->Get(source, vpos);
-         Vector4 pos = vpos.GetVector4();
-         LineEdit* ed = AddLineEdit(row,"X", String(pos.x_));
-                    ed->SetVar("Type",VAR_VECTOR4);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-         ed = AddLineEdit(row,"Y", String(pos.y_));
-                    ed->SetVar("Type",VAR_VECTOR4);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-         ed = AddLineEdit(row,"Z", String(pos.z_));
-                    ed->SetVar("Type",VAR_VECTOR4);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-         ed = AddLineEdit(row,"W", String(pos.w_));
-                    ed->SetVar("Type",VAR_VECTOR4);
-                    ed->SetVar("Attribute",info->name_);
-                    ed->SetVar("Source",source);
-        }
+        Vector4 pos = GetAttributeValue(source, info).GetVector4();
+        BindAttributeField(AddLineEdit(row,"X", String(pos.x_)), source, info, 0);
+        BindAttributeField(AddLineEdit(row,"Y", String(pos.y_)), source, info, 1);
+        BindAttributeField(AddLineEdit(row,"Z", String(pos.z_)), source, info, 2);
+        BindAttributeField(AddLineEdit(row,"W", String(pos.w_)), source, info, 3);
     }
 
     void InGameEditor::AddAttribute_Quaternion(Serializable* source, UIElement* container, const AttributeInfo* info){
         UIElement* row = AddRow(container);
         Button* btn = AddButton(row, info->name_+": ", Color::GREEN);
 
-        if(info->ptr_){
-        const Quaternion* pos = (Quaternion*)info->ptr_;
-        LineEdit* ed = AddLineEdit(row,"X", String(pos->x_));
-        ed->SetVar("Attribute",info->name_);
-        ed->SetVar("Type",VAR_QUATERNION);
-        ed->SetVar("Source",source);
-        ed = AddLineEdit(row,"Y", String(pos->y_));
-        ed->SetVar("Attribute",info->name_);
-        ed->SetVar("Type",VAR_QUATERNION);
-        ed->SetVar("Source",source);
-        ed = AddLineEdit(row,"Z", String(pos->z_));
-        ed->SetVar("Attribute",info->name_);
-        ed->SetVar("Type",VAR_QUATERNION);
-        ed->SetVar("Source",source);
-        ed = AddLineEdit(row,"W", String(pos->w_));
-        ed->SetVar("Attribute",info->name_);
-        ed->SetVar("Type",VAR_QUATERNION);
-        ed->SetVar("Source",source);
-        }else{
-
-         Variant vpos;
-         info->accessor_->Get(source, vpos);
-         Quaternion pos = vpos.GetQuaternion();
-         LineEdit* ed = AddLineEdit(row,"X", String(pos.x_));
-         ed->SetVar("Attribute",info->name_);
-         ed->SetVar("Type",VAR_QUATERNION);
-         ed->SetVar("Source",source);
-         ed = AddLineEdit(row,"Y", String(pos.y_));
-        ed->SetVar("Attribute",info->name_);
-        ed->SetVar("Type",VAR_QUATERNION);
-         ed->SetVar("Source",source);
-         ed = AddLineEdit(row,"Z", String(pos.z_));
-        ed->SetVar("Attribute",info->name_);
-        ed->SetVar("Type",VAR_QUATERNION);
-         ed->SetVar("Source",source);
-         ed = AddLineEdit(row,"W", String(pos.w_));
-        ed->SetVar("Attribute",info->name_);
-        ed->SetVar("Type",VAR_QUATERNION);
-         ed->SetVar("Source",source);
-
-        }
+        Quaternion pos = GetAttributeValue(source, info).GetQuaternion();
+        BindAttributeField(AddLineEdit(row,"X", String(pos.x_)), source, info, 0);
+        BindAttributeField(AddLineEdit(row,"Y", String(pos.y_)), source, info, 1);
+        BindAttributeField(AddLineEdit(row,"Z", String(pos.z_)), source, info, 2);
+        BindAttributeField(AddLineEdit(row,"W", String(pos.w_)), source, info, 3);
     }
 
     void InGameEditor::AddAttribute_Float(Serializable* source, UIElement* container, const AttributeInfo* info){
         UIElement* row = AddRow(container);
         Button* btn = AddButton(row, info->name_+": ", Color::GREEN);
 
-        if(info->ptr_){
-            const float* val = (float*)info->ptr_;
-            LineEdit* ed = AddLineEdit(row,info->name_, String(*val));
-            ed->SetVar("Attribute",info->name_);
-            ed->SetVar("Type",VAR_FLOAT);
-            ed->SetVar("Source",source);
-        }else{
-
-             Variant val;
-             info->accessor_->Get(source, val);
-             LineEdit* ed = AddLineEdit(row,info->name_, val.ToString());
-             ed->SetVar("Attribute",info->name_);
-             ed->SetVar("Type",VAR_FLOAT);
-             ed->SetVar("Source",source);
-        }
+        float val = GetAttributeValue(source, info).GetFloat();
+        BindAttributeField(AddLineEdit(row,info->name_, String(val)), source, info);
     }
 
     void InGameEditor::AddAttribute_Bool(Serializable* source, UIElement* container, const AttributeInfo* info){
         UIElement* row = AddRow(container);
         Button* btn = AddButton(row, info->name_+": ", Color::GREEN);
 
-        if(info->ptr_){
-            const bool* val = (bool*)info->ptr_;
-            LineEdit* ed = AddLineEdit(row,info->name_, String(*val));
-            ed->SetVar("Attribute",info->name_);
-            ed->SetVar("Type",VAR_BOOL);
-            ed->SetVar("Source",source);
-        }else{
-
-             Variant val;
-             info->accessor_->Get(source, val);
-             LineEdit* ed = AddLineEdit(row, info->name_, String(val.GetBool()) );
-             ed->SetVar("Attribute",info->name_);
-             ed->SetVar("Type",VAR_BOOL);
-             ed->SetVar("Source",source);
-        }
+        bool val = GetAttributeValue(source, info).GetBool();
+        BindAttributeField(AddLineEdit(row,info->name_, String(val)), source, info);
     }
 
     void InGameEditor::AddAttribute_Int(Serializable* source, UIElement* container, const AttributeInfo* info){
         UIElement* row = AddRow(container);
         Button* btn = AddButton(row, info->name_+": ", Color::GREEN);
 
-        if(info->ptr_){
-            const int* val = (int*)info->ptr_;
-            LineEdit* ed = AddLineEdit(row,info->name_, String(*val));
-            ed->SetVar("Attribute",info->name_);
-            ed->SetVar("Type",VAR_INT);
-            ed->SetVar("Source",source);
-        }else{
-
-             Variant val;
-             info->accessor_->Get(source, val);
-             LineEdit* ed = AddLineEdit(row, info->name_, String(val.GetInt()) );
-             ed->SetVar("Attribute",info->name_);
-             ed->SetVar("Type",VAR_INT);
-             ed->SetVar("Source",source);
-        }
+        int val = GetAttributeValue(source, info).GetInt();
+        BindAttributeField(AddLineEdit(row,info->name_, String(val)), source, info);
     }
 
     void InGameEditor::AddAttribute_String(Serializable* source, UIElement* container, const AttributeInfo* info){
         UIElement* row = AddRow(container);
         Button* btn = AddButton(row, info->name_+": ", Color::GREEN);
 
-        if(info->ptr_){
-            const String* val = (String*)info->ptr_;
-            LineEdit* edit = AddLineEdit(row,info->name_, *val);
-            edit->SetVar("Attribute",info->name_);
-            edit->SetVar("Type",info->type_);
-            edit->SetVar("Source",source);
-        }else{
-
-             Variant val;
-             info->accessor_->Get(source, val);
-             LineEdit* edit = AddLineEdit(row,info->name_, val.GetString());
-             edit->SetVar("Attribute",info->name_);
-             edit->SetVar("Type",info->type_);
-             edit->SetVar("Source",source);
-
-        }
+        String val = GetAttributeValue(source, info).GetString();
+        BindAttributeField(AddLineEdit(row,info->name_, val), source, info);
     }
 
     void InGameEditor::AddAttribute_StringVector(Serializable* source, UIElement* container, const AttributeInfo* info){
@@ -921,7 +845,8 @@
         auto* row = AddRow(container);
         Button* btn = AddButton(row, info->name_+": ", Color::GREEN);
 
-        AddText(row, ref.name_);
+        /// Edit the resource name - the resource type stays the same
+        BindAttributeField(AddLineEdit(row, info->name_, ref.name_), source, info);
 
     }
 
@@ -958,14 +883,16 @@
 
 
 
+        /// One editable row per resource name (ie one material per geometry)
         for(int i=0;i<refs.names_.Size();i++){
-                auto* text=new Text(context_);
-        text->SetName(refs.names_[i]);
-        //text->SetFont(font);
-        text->SetText(refs.names_[i]);
-        text->SetStyleAuto();
-        img->AddItem(text);
-
+            auto* edit=new LineEdit(context_);
+            edit->SetName(refs.names_[i]);
+            edit->SetStyleAuto();
+            edit->SetText(refs.names_[i]);
+            edit->SetCursorPosition(0);
+            edit->SetMinWidth(96);
+            img->AddItem(edit);
+            BindAttributeField(edit, source, info, i);
         }
 
         //    InsertLineEdit(list,refs.names_[i],refs.names_[i]);
@@ -992,30 +919,74 @@
         if(HierarchyWindow_)
         {
             HierarchyWindow_->SetPosition(HierarchyPos_);
-            return;
         }
+        else
+        {
+            /// Create a basic GUI Window (with title bar, close button, and content panel)
+            HierarchyWindow_=CreateWindow("Hierarchy","Scene Hierarchy");
 
-        /// Create a basic GUI Window (with title bar, close button, and content panel)
-        HierarchyWindow_=CreateWindow("Hierarchy","Scene Hierarchy");
+            /// Create UI ListView Element in "Hierarchy Mode" (AKA TreeView)
+            ListView* meh=CreateTreeView_FixedSize(HierarchyWindow_, "ListContent", 300, 300);
 
-        /// Create UI ListView Element in "Hierarchy Mode" (AKA TreeView)
-        ListView* meh=CreateTreeView_FixedSize(HierarchyWindow_, "ListContent", 300, 300);
+            /// Add UI TreeView element to Scene Hierarchy Window
+            HierarchyWindow_->AddChild(meh);
+        }
 
-        /// Add UI TreeView element to Scene Hierarchy Window
-        HierarchyWindow_->AddChild(meh);
+        /// Create the virtualized view (for big scenes) alongside the regular one - we only show one at a time
+        virtualHierarchy_ = new VirtualTreeView(context_);
+        virtualHierarchy_->Create(HierarchyWindow_, 300, 300);
+        virtualHierarchy_->SetScene(GetScene());
+    }
+
+    /// Show either the regular hierarchy ListView, or the virtualized view.
+    /// The regular view is emptied while not in use, so it costs nothing to keep up to date
+    void InGameEditor::ApplyHierarchyMode(){
+        ListView* meh = (ListView*)HierarchyWindow_->GetChild("ListContent",false);
+        meh->SetVisible(!useVirtualHierarchy_);
+        virtualHierarchy_->GetRoot()->SetVisible(useVirtualHierarchy_);
+
+        if(useVirtualHierarchy_){
+            meh->RemoveAllItems();
+            hierarchyNodeItems_.Clear();
+            hierarchyComponentItems_.Clear();
+            virtualHierarchy_->MarkDirty();
+            SelectHierarchyItem();
+        }
+        else
+            RebuildHierarchy(meh, GetScene());
     }
 
+    /// Rebuild the entire hierarchy from scratch - only needed when the editor starts up,
+    /// after that, we update individual rows in response to scene events (see below)
     void InGameEditor::RebuildHierarchy(ListView* meh, Node* node, UIElement* parent){
         meh->RemoveAllItems();
+        hierarchyNodeItems_.Clear();
+        hierarchyComponentItems_.Clear();
         RebuildHierarchyRecursive(meh,node,parent);
+        SelectHierarchyItem();
     }
 
     void InGameEditor::RebuildHierarchyRecursive(ListView* meh, Node* node, UIElement* parent){
 
-
         /// Add current node to list
+        Text* t3=AddHierarchyNodeItem(meh, node, parent);
+
+        /// Add all Components of the input node
+        const Vector<SharedPtr<Component>>& ccc = node->GetComponents();
+        for(unsigned j=0; j<ccc.Size();j++)
+            AddHierarchyComponentItem(meh, ccc[j], t3);
+
+        /// Add all child nodes of the input node
+        for(unsigned i=0;i<node->GetNumChildren();i++)
+        {
+            /// Recurse child node
+            RebuildHierarchyRecursive(meh, node->GetChild(i), t3);
+        }
+    }
+
+    Text* InGameEditor::AddHierarchyNodeItem(ListView* meh, Node* node, UIElement* parent){
         Text* t3=new Text(context_);
-        meh->InsertItem(-1,t3,parent);
+        meh->InsertItem(M_MAX_UNSIGNED,t3,parent);
 
         t3->SetStyle("FileSelectorListText");  /// Provides selection highlighting
         t3->SetText(node->GetName()+" - "+String(node->GetID()));
@@ -1023,101 +994,253 @@
         t3->SetVar("NodeID",node->GetID());
         t3->SetColor(Color(0.0f,1.0f,1.0f));
 
+        hierarchyNodeItems_[node->GetID()]=t3;
+        return t3;
+    }
 
+    Text* InGameEditor::AddHierarchyComponentItem(ListView* meh, Component* comp, UIElement* parent, unsigned index){
+        Text* t4=new Text(context_);
+        meh->InsertItem(index,t4,parent);
 
-        /// Add all Components of the input node
-        Vector<SharedPtr<Component>> ccc = node->GetComponents();
-        for(int j=0; j<node->GetNumComponents();j++){
-            Component* comp = ccc[j];
-
-            Text* t4=new Text(context_);
-            meh->InsertItem(-1,t4,t3);
-            t4->SetStyle("FileSelectorListText");  /// Provides selection highlighting
-            t4->SetText(comp->GetTypeName()+" - "+String(comp->GetID()));
-            t4->SetInternal(true);
-            t4->SetVar("ComponentID",comp->GetID());
-            t4->SetColor(Color(0,1,0));
-
-            if(selectedComponent_ && selectedComponent_->GetID()==comp->GetID())
-            {
+        t4->SetStyle("FileSelectorListText");  /// Provides selection highlighting
+        t4->SetText(comp->GetTypeName()+" - "+String(comp->GetID()));
+        t4->SetInternal(true);
+        t4->SetVar("ComponentID",comp->GetID());
+        t4->SetColor(Color(0,1,0));
+
+        hierarchyComponentItems_[comp->GetID()]=t4;
+        return t4;
+    }
+
+    /// Drop our lookup entries for a node, its components, and all its descendants
+    /// (their ListView items are removed along with the node's item)
+    void InGameEditor::ForgetHierarchyItems(Node* node){
+        hierarchyNodeItems_.Erase(node->GetID());
+
+        const Vector<SharedPtr<Component>>& ccc = node->GetComponents();
+        for(unsigned j=0; j<ccc.Size();j++)
+            hierarchyComponentItems_.Erase(ccc[j]->GetID());
+
+        for(unsigned i=0;i<node->GetNumChildren();i++)
+            ForgetHierarchyItems(node->GetChild(i));
+    }
+
+    /// Returns the regular hierarchy ListView, or null if it's not in use
+    ListView* InGameEditor::GetHierarchyList(){
+        if(!HierarchyWindow_ || useVirtualHierarchy_)
+            return nullptr;
+        return (ListView*)HierarchyWindow_->GetChild("ListContent",false);
+    }
+
+    /// Highlight the hierarchy item for the current selection (component if we have one, otherwise node)
+    /// With a multi-selection, every selected node's item is highlighted as well
+    void InGameEditor::SelectHierarchyItem(){
+        PruneSelection();
 
-                meh->SetSelection(j);
+        HashSet<unsigned> selectedIDs;
+        if(selection_.Size()>1)
+            for(unsigned i=0; i<selection_.Size(); i++)
+                selectedIDs.Insert(selection_[i]->GetID());
 
+        if(useVirtualHierarchy_ && virtualHierarchy_){
+            virtualHierarchy_->Select(selectedNode_, selectedComponent_, selectedIDs);
+            return;
+        }
+
+        ListView* meh = GetHierarchyList();
+        if(!meh)
+            return;
+
+        if(selectedIDs.Size()){
+            /// One pass over the items, rather than a FindItem per selected node
+            PODVector<unsigned> indices;
+            unsigned primaryComponentID = selectedComponent_ ? selectedComponent_->GetID() : 0;
+            for(unsigned i=0; i<meh->GetNumItems(); i++){
+                UIElement* item = meh->GetItem(i);
+                const Variant& nodeID = item->GetVar("NodeID");
+                if(nodeID.GetType()!=VAR_NONE){
+                    if(selectedIDs.Contains(nodeID.GetUInt()))
+                        indices.Push(i);
+                }else if(primaryComponentID && item->GetVar("ComponentID").GetUInt()==primaryComponentID)
+                    indices.Push(i);
             }
+            meh->SetMultiselect(true);
+            meh->SetSelections(indices);
+            return;
+        }
+
+        meh->SetMultiselect(false);
 
+        UIElement* item=nullptr;
+        if(selectedComponent_){
+            auto it=hierarchyComponentItems_.Find(selectedComponent_->GetID());
+            if(it!=hierarchyComponentItems_.End())
+                item=it->second_;
+        }
+        if(!item && selectedNode_){
+            auto it=hierarchyNodeItems_.Find(selectedNode_->GetID());
+            if(it!=hierarchyNodeItems_.End())
+                item=it->second_;
         }
 
-        /// Add all child nodes of the input node
-        for(int i=0;i<node->GetNumChildren();i++)
-        {
-            /// Recurse child node
-            RebuildHierarchyRecursive(meh, node->GetChild(i), t3);
+        if(!item){
+            meh->ClearSelection();
+            return;
+        }
 
+        unsigned index=meh->FindItem(item);
+        if(index!=M_MAX_UNSIGNED && meh->GetSelection()!=index){
+            meh->SetSelection(index);
+            meh->EnsureItemVisibility(item);
         }
+    }
 
+    /////////////////////////////////////////////////////////////////////////////////////////////
+    /// Incremental Scene Hierarchy updates
+
+    void InGameEditor::HandleSceneNodeAdded(StringHash eventType, VariantMap& eventData){
+        using namespace NodeAdded;
+        InvalidatePick();
+        if(virtualHierarchy_)
+            virtualHierarchy_->MarkDirty();
+
+        ListView* meh = GetHierarchyList();
+        if(!meh)
+            return;
+
+        Node* node   = (Node*)eventData[P_NODE].GetPtr();
+        Node* parent = (Node*)eventData[P_PARENT].GetPtr();
+
+        auto it=hierarchyNodeItems_.Find(parent->GetID());
+        if(it==hierarchyNodeItems_.End() || !it->second_)
+            return;
+
+        /// The node may arrive with components and children already attached
+        RebuildHierarchyRecursive(meh, node, it->second_);
     }
 
+    void InGameEditor::HandleSceneNodeRemoved(StringHash eventType, VariantMap& eventData){
+        using namespace NodeRemoved;
+        InvalidatePick();
+        if(virtualHierarchy_)
+            virtualHierarchy_->MarkDirty();
+
+        ListView* meh = GetHierarchyList();
+        if(!meh)
+            return;
+
+        Node* node = (Node*)eventData[P_NODE].GetPtr();
+
+        auto it=hierarchyNodeItems_.Find(node->GetID());
+        if(it==hierarchyNodeItems_.End())
+            return;
+
+        /// In hierarchy mode, the ListView removes all child items too
+        UIElement* item = it->second_;
+        ForgetHierarchyItems(node);
+        if(item)
+            meh->RemoveItem(item);
+    }
+
+    void InGameEditor::HandleSceneComponentAdded(StringHash eventType, VariantMap& eventData){
+        using namespace ComponentAdded;
+        InvalidatePick();
+        if(virtualHierarchy_)
+            virtualHierarchy_->MarkDirty();
+
+        ListView* meh = GetHierarchyList();
+        if(!meh)
+            return;
+
+        Node* node      = (Node*)eventData[P_NODE].GetPtr();
+        Component* comp = (Component*)eventData[P_COMPONENT].GetPtr();
+
+        auto it=hierarchyNodeItems_.Find(node->GetID());
+        if(it==hierarchyNodeItems_.End() || !it->second_)
+            return;
+        UIElement* parent = it->second_;
+
+        /// Component items are listed directly below their node's item, ahead of any child node items
+        unsigned index = meh->FindItem(parent);
+        unsigned numItems = meh->GetNumItems();
+        while(++index<numItems){
+            UIElement* item = meh->GetItem(index);
+            if(item->GetIndent()<=parent->GetIndent() || item->GetVar("ComponentID").GetType()==VAR_NONE)
+                break;
+        }
+
+        AddHierarchyComponentItem(meh, comp, parent, index);
+    }
+
+    void InGameEditor::HandleSceneComponentRemoved(StringHash eventType, VariantMap& eventData){
+        using namespace ComponentRemoved;
+        InvalidatePick();
+        if(virtualHierarchy_)
+            virtualHierarchy_->MarkDirty();
+
+        ListView* meh = GetHierarchyList();
+        if(!meh)
+            return;
+
+        Component* comp = (Component*)eventData[P_COMPONENT].GetPtr();
+
+        auto it=hierarchyComponentItems_.Find(comp->GetID());
+        if(it==hierarchyComponentItems_.End())
+            return;
+
+        UIElement* item = it->second_;
+        hierarchyComponentItems_.Erase(it);
+        if(item)
+            meh->RemoveItem(item);
+    }
+
+    void InGameEditor::HandleSceneNodeNameChanged(StringHash eventType, VariantMap& eventData){
+        using namespace NodeNameChanged;
+        if(virtualHierarchy_)
+            virtualHierarchy_->MarkDirty();
+
+        Node* node = (Node*)eventData[P_NODE].GetPtr();
+
+        auto it=hierarchyNodeItems_.Find(node->GetID());
+        if(it!=hierarchyNodeItems_.End() && it->second_)
+            static_cast<Text*>(it->second_.Get())->SetText(node->GetName()+" - "+String(node->GetID()));
+    }
 
     void InGameEditor::RebuildInspector_NodeVars(UIElement* panel){
-            const VariantMap vars = selectedNode_->GetVars();
+            const VariantMap& vars = selectedNode_->GetVars();
             for(auto it=vars.Begin();it!=vars.End();it++)
             {
                 auto* row = AddRow(panel);
 
                 String varname = GetScene()->GetVarName(it->first_);
+                VariantType type = it->second_.GetType();
 
+                Vector3 v;
                 Quaternion q;
-                LineEdit* ed;
                 AddText(row, varname + " (" + it->second_.GetTypeName() + ")");
-                switch(it->second_.GetType())
+                switch(type)
                 {
                     case VAR_BOOL:
-                        ed=AddLineEdit(row, varname, String(it->second_.GetBool()));
-                        ed->SetVar("Type",VAR_BOOL);
-                        ed->SetVar("VarName",varname);
+                        BindVarField(AddLineEdit(row, varname, String(it->second_.GetBool())), selectedNode_, it->first_, type);
                         break;
                     case VAR_INT:
-                        ed=AddLineEdit(row, varname, String(it->second_.GetInt()));
-                        ed->SetVar("Type",VAR_INT);
-                        ed->SetVar("VarName",varname);
+                        BindVarField(AddLineEdit(row, varname, String(it->second_.GetInt())), selectedNode_, it->first_, type);
                         break;
                     case VAR_FLOAT:
-                        ed=AddLineEdit(row, varname, String(it->second_.GetFloat()));
-                        ed->SetVar("Type",VAR_FLOAT);
-                        ed->SetVar("VarName",varname);
+                        BindVarField(AddLineEdit(row, varname, String(it->second_.GetFloat())), selectedNode_, it->first_, type);
                         break;
                     case VAR_VECTOR3:
-                        ed=AddLineEdit(row, varname+"_x", String(it->second_.GetVector3().x_));
-                        ed->SetVar("Type",VAR_FLOAT);
-                        ed->SetVar("VarName",varname);
-
-                        ed=AddLineEdit(row, varname+"_y", String(it->second_.GetVector3().y_));
-                        ed->SetVar("Type",VAR_FLOAT);
-                        ed->SetVar("VarName",varname);
-
-                        ed=AddLineEdit(row, varname+"_z", String(it->second_.GetVector3().z_));
-                        ed->SetVar("Type",VAR_FLOAT);
-                        ed->SetVar("VarName",varname);
-
+                        v = it->second_.GetVector3();
+                        BindVarField(AddLineEdit(row, varname+"_x", String(v.x_)), selectedNode_, it->first_, type, 0);
+                        BindVarField(AddLineEdit(row, varname+"_y", String(v.y_)), selectedNode_, it->first_, type, 1);
+                        BindVarField(AddLineEdit(row, varname+"_z", String(v.z_)), selectedNode_, it->first_, type, 2);
                         break;
                     case VAR_QUATERNION:
                         q = it->second_.GetQuaternion();
-                        ed=AddLineEdit(row, varname+"_x", String(q.x_));
-                        ed->SetVar("Type",VAR_FLOAT);
-                        ed->SetVar("VarName",varname);
-
-                        ed=AddLineEdit(row, varname+"_y", String(q.y_));
-                        ed->SetVar("Type",VAR_FLOAT);
-                        ed->SetVar("VarName",varname);
-
-                        ed=AddLineEdit(row, varname+"_z", String(q.z_));
-                        ed->SetVar("Type",VAR_FLOAT);
-                        ed->SetVar("VarName",varname);
-
-                        ed=AddLineEdit(row, varname+"_w", String(q.w_));
-                        ed->SetVar("Type",VAR_FLOAT);
-                        ed->SetVar("VarName",varname);
-
+                        BindVarField(AddLineEdit(row, varname+"_x", String(q.x_)), selectedNode_, it->first_, type, 0);
+                        BindVarField(AddLineEdit(row, varname+"_y", String(q.y_)), selectedNode_, it->first_, type, 1);
+                        BindVarField(AddLineEdit(row, varname+"_z", String(q.z_)), selectedNode_, it->first_, type, 2);
+                        BindVarField(AddLineEdit(row, varname+"_w", String(q.w_)), selectedNode_, it->first_, type, 3);
                         break;
 
                     default:
@@ -1226,31 +1349,234 @@
         }
     }
 
-    /// GUI WINDOW: Rebuild content of the Inspector Window
-    void InGameEditor::RebuildInspector(){
+    /// Utility: Create a vertical container UI Element, used to hold an Inspector section
+    UIElement* InGameEditor::AddSectionHolder(UIElement* container){
+        UIElement* holder = new UIElement(context_);
+        holder->SetLayout(LM_VERTICAL);
+        container->AddChild(holder);
+        return holder;
+    }
+
+    /// Format a (part of a) value the same way our AddAttribute methods do
+    /// part = 0..3 for the x,y,z,w of vector and quaternion types
+    static String FormatInspectorValue(const Variant& value, int part){
+        switch(value.GetType()){
+            case VAR_VECTOR2:       return String(value.GetVector2().Data()[Clamp(part,0,1)]);
+            case VAR_VECTOR3:       return String(value.GetVector3().Data()[Clamp(part,0,2)]);
+            case VAR_VECTOR4:       return String(value.GetVector4().Data()[Clamp(part,0,3)]);
+            case VAR_QUATERNION:{
+                /// Quaternion data is stored w,x,y,z - but we display x,y,z,w
+                const Quaternion& q = value.GetQuaternion();
+                return String(part==0 ? q.x_ : part==1 ? q.y_ : part==2 ? q.z_ : q.w_);
+            }
+            case VAR_BOOL:          return String(value.GetBool());
+            case VAR_INT:           return String(value.GetInt());
+            case VAR_FLOAT:         return String(value.GetFloat());
+            case VAR_STRING:        return value.GetString();
+            case VAR_RESOURCEREF:   return value.GetResourceRef().name_;
+            case VAR_RESOURCEREFLIST:{
+                const StringVector& names = value.GetResourceRefList().names_;
+                return (unsigned)part < names.Size() ? names[part] : String::EMPTY;
+            }
+            default:                return value.ToString();
+        }
+    }
+
+    /// Read the current value of a bound field's attribute or node var
+    static Variant GetBoundValue(const FieldBinding& binding){
+        if(binding.index_==M_MAX_UNSIGNED)
+            return static_cast<Node*>(binding.source_.Get())->GetVar(binding.var_);
+        return binding.source_->GetAttribute(binding.index_);
+    }
+
+    /// Convert the text of an edited field into the new value for the bound attribute or var
+    /// For part edits, only that part of the current value is replaced - so when we apply one edit
+    /// to many objects, each keeps the rest of its own value (ie set X of 500 positions)
+    static bool ParseFieldValue(const FieldBinding& binding, const Variant& current, const String& text, Variant& value){
+        if(binding.part_<0){
+            if(binding.type_==VAR_RESOURCEREF){
+                /// We display just the resource name - keep the resource type
+                value = ResourceRef(current.GetResourceRef().type_, text.Trimmed());
+                return true;
+            }
+            /// Convert user plaintext into typed variant
+            value.FromString(binding.type_, text);
+            return true;
+        }
+
+        /// Replace one part of a vector, quaternion or resource list value
+        float fval = ToFloat(text);
+        switch(binding.type_){
+            case VAR_VECTOR2:{
+                Vector2 v = current.GetVector2();
+                (&v.x_)[Clamp(binding.part_,0,1)] = fval;
+                value = v;
+                return true;
+            }
+            case VAR_VECTOR3:{
+                Vector3 v = current.GetVector3();
+                (&v.x_)[Clamp(binding.part_,0,2)] = fval;
+                value = v;
+                return true;
+            }
+            case VAR_VECTOR4:{
+                Vector4 v = current.GetVector4();
+                (&v.x_)[Clamp(binding.part_,0,3)] = fval;
+                value = v;
+                return true;
+            }
+            case VAR_QUATERNION:{
+                Quaternion q = current.GetQuaternion();
+                if(binding.part_==0)      q.x_ = fval;
+                else if(binding.part_==1) q.y_ = fval;
+                else if(binding.part_==2) q.z_ = fval;
+                else                      q.w_ = fval;
+                value = q;
+                return true;
+            }
+            case VAR_RESOURCEREFLIST:{
+                ResourceRefList refs = current.GetResourceRefList();
+                if((unsigned)binding.part_ >= refs.names_.Size())
+                    return false;
+                refs.names_[binding.part_] = text.Trimmed();
+                value = refs;
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+    /// Collect the bound fields of a freshly built Inspector section
+    void InGameEditor::ScanInspectorFields(InspectorSection& section, Serializable* source, bool isVars){
+        section.fields_.Clear();
+        section.listValues_.Clear();
+
+        PODVector<UIElement*> elements;
+        section.root_->GetChildren(elements, true);
+        for(unsigned i=0; i<elements.Size(); i++){
+            if(fieldBindings_.Contains(elements[i]))
+                section.fields_.Push(elements[i]);
+        }
+
+        /// List-style rows can't be refreshed in place - we remember what they show instead
+        const Vector<AttributeInfo>* attribs = source->GetAttributes();
+        if(attribs && !isVars){
+            for(unsigned j=0; j<attribs->Size(); j++){
+                VariantType type = attribs->At(j).type_;
+                if(type==VAR_STRINGVECTOR || type==VAR_RESOURCEREFLIST)
+                    section.listValues_.Push(MakePair(j, source->GetAttribute(j)));
+            }
+        }
+
+        section.source_ = source;
+    }
+
+    /// Drop the field bindings of an Inspector section, before its rows are destroyed
+    void InGameEditor::ForgetInspectorSection(InspectorSection& section){
+        for(unsigned i=0; i<section.fields_.Size(); i++)
+            fieldBindings_.Erase(section.fields_[i]);
+        section.fields_.Clear();
+        if(section.root_)
+            section.root_->Remove();
+        section.root_.Reset();
+    }
+
+    /// Refresh the values displayed by a cached Inspector section, rebinding it to a new source if needed
+    /// Returns false if the section can't display the source's values, and must be rebuilt
+    bool InGameEditor::RefreshInspectorSection(InspectorSection& section, Serializable* source){
+
+        for(unsigned i=0; i<section.listValues_.Size(); i++){
+            if(source->GetAttribute(section.listValues_[i].first_)!=section.listValues_[i].second_)
+                return false;
+        }
+
+        bool rebind = section.source_!=source;
+
+        for(unsigned i=0; i<section.fields_.Size(); i++){
+            /// Section rows are kept alive by the section root, so the element pointers are safe
+            UIElement* e = section.fields_[i];
+            auto it = fieldBindings_.Find(e);
+            if(it==fieldBindings_.End())
+                return false;
+
+            FieldBinding& binding = it->second_;
+            if(rebind)
+                binding.source_ = source;
+            if(!binding.source_)
+                return false;
+
+            /// Only touch widgets whose value has changed, and never the one the user is typing into
+            String text = FormatInspectorValue(GetBoundValue(binding), binding.part_);
+            if(e->IsInstanceOf<LineEdit>()){
+                LineEdit* ed = static_cast<LineEdit*>(e);
+                if(!ed->HasFocus() && ed->GetText()!=text){
+                    ed->SetText(text);
+                    ed->SetCursorPosition(0);
+                }
+            }
+            else if(e->IsInstanceOf<Text>()){
+                Text* t = static_cast<Text*>(e);
+                if(t->GetText()!=text)
+                    t->SetText(text);
+            }
+        }
+
+        section.source_ = source;
+        return true;
+    }
+
+    /// Display an attribute section for the given source (node or component) in the given holder element
+    /// Sections are cached by type, so selecting another object of the same type just rebinds the rows
+    /// Returns true if the holder's content was changed
+    bool InGameEditor::ShowInspectorSection(UIElement* holder, Serializable* source, bool isNode){
+        InspectorSection& section = inspectorSections_[source->GetType()];
 
-        if(!selectedNode_)
-            selectedNode_=GetScene();
+        if(section.root_ && RefreshInspectorSection(section, source)){
+            if(section.root_->GetParent()==holder)
+                return false;
+            holder->RemoveAllChildren();
+            holder->AddChild(section.root_);
+            return true;
+        }
 
+        /// Build new rows for this type of object
+        ForgetInspectorSection(section);
+        section.root_ = new UIElement(context_);
+        section.root_->SetLayout(LM_VERTICAL);
+        if(isNode)
+            RebuildInspector_NodeAttribs(section.root_);
+        else
+            RebuildInspector_ComponentAttribs(section.root_);
+        ScanInspectorFields(section, source);
 
+        holder->RemoveAllChildren();
+        holder->AddChild(section.root_);
+        return true;
+    }
 
-        /// Trash existing content in the UI "Panel" element
-        /// (we leave the window titlebar etc intact)
-        UIElement* panel = InspectorWindow_->GetChild("Panel",true);
+    /// GUI WINDOW: Create the fixed layout of the Inspector Window
+    /// (header rows, collapsing section dividers, and empty holders for the sections themselves)
+    void InGameEditor::CreateInspectorLayout(UIElement* panel){
 
+        /// Trash existing content in the UI "Panel" element, ie left behind by a previous editor instance
+        /// (we leave the window titlebar etc intact)
         panel->RemoveAllChildren();
-
-        InspectorWindow_->SetSize(384,24);
+        inspectorSections_.Clear();
+        inspectorVars_ = InspectorSection();
+        fieldBindings_.Clear();
+        inspectorListSource_ = nullptr;
 
         /// Add a new Row to the panel
         UIElement* row = AddRow(panel);
 
         /// Add a Button to the Row
-        Button* btn = AddButton(row, "Node ID: "+String(selectedNode_->GetID()), Color::RED);
+        Button* btn = AddButton(row, "Node ID: ", Color::RED);
         btn->SetColor(Color::GREEN);
+        inspectorNodeIDText_ = static_cast<Text*>(btn->GetChild(0));
 
         /// Add a Text to the Row
-        Text* t = AddText(row, selectedNode_->GetName(),Color::GREEN, TE_SHADOW);
+        inspectorNodeNameText_ = AddText(row, "", Color::GREEN, TE_SHADOW);
 
         ///////////
         /// Add a second Row to the panel
@@ -1262,94 +1588,185 @@
         btn->SetColor(Color::RED);
 
         /// Add some text to describe the state of the toggle in human terms
-        if(useLocalSpace)
-            AddText(row, "Local (Relative)", Color::RED);
-        else
-            AddText(row, "World (Absolute)", Color::RED);
+        inspectorSpaceText_ = AddText(row, "", Color::RED);
 
         /// Subscribe to receive notification of Button Click events
         SubscribeToEvent(btn, E_CLICK, URHO3D_HANDLER(InGameEditor, HandleUIButtonClick));
 
-
+        ///////////
+        /// Add a third Row, for toggling Live Watch mode
+        row = AddRow(panel);
+        btn = AddButton(row, "Live Watch: ", Color::GREEN);
+        btn->SetName("LiveWatchToggleButton");
+        btn->SetColor(Color::RED);
+        inspectorLiveWatchText_ = AddText(row, "", Color::RED);
+        SubscribeToEvent(btn, E_CLICK, URHO3D_HANDLER(InGameEditor, HandleUIButtonClick));
 
         ////////////////////////////////////////////////////
-        // NODE VARIABLES
         AddVerticalDivider(panel, "Variables");
-        if(hideVars==false)
-            RebuildInspector_NodeVars(panel);
+        inspectorVarsHolder_ = AddSectionHolder(panel);
 
-        ////////////////////////////////////////////////////
-        // NODE ATTRIBUTES
         AddVerticalDivider(panel,"Node Attributes");
-        if(hideNodeAttribs==false)
-            RebuildInspector_NodeAttribs(panel);
+        inspectorNodeHolder_ = AddSectionHolder(panel);
 
-        ////////////////////////////////////////////////////
-        // COMPONENT ATTRIBUTES
         AddVerticalDivider(panel,"Component Attributes");
-        if(!selectedComponent_)
-        {
-            /// Display full list of Components owned by selected Node
-            Vector<SharedPtr<Component>> comps = selectedNode_->GetComponents();
-            for(int i=0;i<selectedNode_->GetNumComponents();i++){
-                row = AddRow(panel);
-                AddText(row,comps[i]->GetTypeName(), Color::MAGENTA);
-            }
+        inspectorComponentListHolder_ = AddSectionHolder(panel);
+        inspectorComponentHolder_ = AddSectionHolder(panel);
+    }
 
-        } else {
+    /// Live Watch: refresh just the values displayed by the visible Inspector sections
+    /// Falls back to UpdateInspector if something changed that needs new rows (a node var was added, removed or retyped)
+    void InGameEditor::RefreshInspectorValues(){
+        if(!selectedNode_ || !inspectorNodeIDText_){
+            UpdateInspector();
+            return;
+        }
 
-            /// Display name of selected Component
-            row = AddRow(panel);
-            AddText(row,selectedComponent_->GetTypeName(), Color::MAGENTA);
+        bool ok = true;
+        if(!hideVars && inspectorVars_.root_)
+            ok = inspectorVars_.signature_==GetVarsSignature(selectedNode_->GetVars()) && RefreshInspectorSection(inspectorVars_, selectedNode_);
 
-            /// Optionally, display Component Attributes
-            if(hideComponentAttribs==false)
-                RebuildInspector_ComponentAttribs(panel);
+        if(ok && !hideNodeAttribs){
+            auto it = inspectorSections_.Find(selectedNode_->GetType());
+            ok = it!=inspectorSections_.End() && it->second_.root_ && RefreshInspectorSection(it->second_, selectedNode_);
         }
 
+        if(ok && selectedComponent_ && !hideComponentAttribs){
+            auto it = inspectorSections_.Find(selectedComponent_->GetType());
+            ok = it!=inspectorSections_.End() && it->second_.root_ && RefreshInspectorSection(it->second_, selectedComponent_);
+        }
 
+        if(!ok || (!selectedComponent_ && selectedNode_->GetNumComponents()!=inspectorListCount_))
+            UpdateInspector();
+    }
 
+    /// The var rows depend on which vars the node has, and their types
+    unsigned InGameEditor::GetVarsSignature(const VariantMap& vars){
+        unsigned signature=vars.Size();
+        for(auto it=vars.Begin();it!=vars.End();it++)
+            signature = signature*31 + it->first_.Value()*7 + it->second_.GetType();
+        return signature;
     }
 
-    /////////////////////////////////////////////////////////////////////////////////////////////
-    /// Load gameScene from XML file
-    bool InGameEditor::LoadSceneFromXML(String filepath){
-        bool success = false;
-        /// Open a SceneFile for Loading
-        Urho3D::File file(context_, filepath, FILE_READ);
-        if(file.IsOpen())
-        {
-            success = GetScene()->LoadXML(file);
+    /// GUI WINDOW: Bring the Inspector Window up to date with the current selection
+    /// Widgets are created only when the layout of what we're displaying changes -
+    /// otherwise we just refresh the values that have changed
+    void InGameEditor::UpdateInspector(){
 
+        if(!selectedNode_)
+            selectedNode_=GetScene();
 
-            file.Close();
+        UIElement* panel = InspectorWindow_->GetChild("Panel",true);
+        if(!inspectorNodeIDText_)
+            CreateInspectorLayout(panel);
+
+        bool layoutChanged=false;
+
+        /// Header rows
+        PruneSelection();
+        String text="Node ID: "+String(selectedNode_->GetID());
+        if(selection_.Size()>1)
+            text+="  ("+String(selection_.Size())+" selected)";
+        if(inspectorNodeIDText_->GetText()!=text){
+            inspectorNodeIDText_->SetText(text);
+            inspectorNodeIDText_->GetParent()->SetMinWidth(inspectorNodeIDText_->GetWidth());
         }
-        return success;
+        if(inspectorNodeNameText_->GetText()!=selectedNode_->GetName())
+            inspectorNodeNameText_->SetText(selectedNode_->GetName());
+        text = useLocalSpace ? "Local (Relative)" : "World (Absolute)";
+        if(inspectorSpaceText_->GetText()!=text)
+            inspectorSpaceText_->SetText(text);
+        text = liveWatch_ ? "On ("+String(RoundToInt(1.0f/Max(liveWatchInterval_, M_EPSILON)))+" Hz)" : "Off";
+        if(inspectorLiveWatchText_->GetText()!=text)
+            inspectorLiveWatchText_->SetText(text);
 
-    }
+        ////////////////////////////////////////////////////
+        // NODE VARIABLES
+        inspectorVarsHolder_->SetVisible(!hideVars);
+        if(hideVars==false){
+
+            unsigned signature=GetVarsSignature(selectedNode_->GetVars());
+            if(!inspectorVars_.root_ || inspectorVars_.signature_!=signature || !RefreshInspectorSection(inspectorVars_, selectedNode_)){
+                ForgetInspectorSection(inspectorVars_);
+                inspectorVars_.root_ = new UIElement(context_);
+                inspectorVars_.root_->SetLayout(LM_VERTICAL);
+                inspectorVars_.signature_ = signature;
+                RebuildInspector_NodeVars(inspectorVars_.root_);
+                ScanInspectorFields(inspectorVars_, selectedNode_, true);
+                inspectorVarsHolder_->AddChild(inspectorVars_.root_);
+                layoutChanged=true;
+            }
+        }
 
-    /// Save gameScene to XML file
-    bool InGameEditor::SaveSceneToXML(String filepath){
-        bool success=false;
-    // Dump our Scene to disk, so we can use it to load from in future
-        Urho3D::File file(context_, filepath, FILE_WRITE);
-        if(file.IsOpen()){
+        ////////////////////////////////////////////////////
+        // NODE ATTRIBUTES
+        inspectorNodeHolder_->SetVisible(!hideNodeAttribs);
+        if(hideNodeAttribs==false)
+            layoutChanged |= ShowInspectorSection(inspectorNodeHolder_, selectedNode_, true);
 
-            Scene* scene = GetScene();
+        ////////////////////////////////////////////////////
+        // COMPONENT ATTRIBUTES
+        Serializable* listSource = selectedComponent_ ? static_cast<Serializable*>(selectedComponent_.Get()) : static_cast<Serializable*>(selectedNode_.Get());
+        unsigned listCount = selectedComponent_ ? 1 : selectedNode_->GetNumComponents();
+        if(inspectorListSource_!=listSource || inspectorListCount_!=listCount){
+            inspectorListSource_ = listSource;
+            inspectorListCount_  = listCount;
+            inspectorComponentListHolder_->RemoveAllChildren();
+            layoutChanged=true;
+
+            if(!selectedComponent_){
+                /// Display full list of Components owned by selected Node
+                const Vector<SharedPtr<Component>>& comps = selectedNode_->GetComponents();
+                for(unsigned i=0;i<comps.Size();i++){
+                    UIElement* row = AddRow(inspectorComponentListHolder_);
+                    AddText(row,comps[i]->GetTypeName(), Color::MAGENTA);
+                }
+            } else {
+                /// Display name of selected Component
+                UIElement* row = AddRow(inspectorComponentListHolder_);
+                AddText(row,selectedComponent_->GetTypeName(), Color::MAGENTA);
+            }
+        }
+
+        /// Optionally, display Component Attributes
+        bool showComponent = selectedComponent_ && hideComponentAttribs==false;
+        inspectorComponentHolder_->SetVisible(showComponent);
+        if(showComponent)
+            layoutChanged |= ShowInspectorSection(inspectorComponentHolder_, selectedComponent_, false);
+
+        if(layoutChanged)
+            InspectorWindow_->SetSize(384,24);
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////
+    /// Load gameScene from file (xml or binary, by file extension)
+    /// If the AsyncSceneLoader subsystem is available, the scene loads in the background,
+    /// and replaces our scene (and this editor instance) when it's ready
+    bool InGameEditor::LoadSceneFromFile(String filepath){
+        /// History refers to objects by ID - it means nothing in another scene
+        history_->Clear();
+        auto* loader = GetSubsystem<AsyncSceneLoader>();
+        if(loader)
+            return loader->Load(filepath);
+        return LoadSceneFile(GetScene(), filepath);
+    }
+
+    /// Save gameScene to file (xml or binary, by file extension)
+    bool InGameEditor::SaveSceneToFile(String filepath){
+        Scene* scene = GetScene();
         scene->RegisterVar("Camera Behaviour");
         scene->RegisterVar("Character Node");
 
         scene->SetVar("Camera Behaviour", cameraBehaviour_);
         scene->SetVar("Character Node", characterNode_->GetID());
 
-            int pos = filepath.FindLast('/');
-            String filename=filepath.Substring(pos);
+        int pos = filepath.FindLast('/');
+        String filename=filepath.Substring(pos);
 
-            scene->SetName(filename);
-            success = scene->SaveXML(file);
-            file.Close();
-        }
-        return success;
+        scene->SetName(filename);
+
+        // Dump our Scene to disk, so we can use it to load from in future
+        return SaveSceneFile(scene, filepath);
     }
 
     bool InGameEditor::SaveNodeToXML(String filepath){
@@ -1363,31 +1780,358 @@
 
     }
 
+    /// Prefabs are instantiated from a binary template if the PrefabCache subsystem is available (parsing the xml only once),
+    /// otherwise straight from the xml
     bool InGameEditor::LoadNodeFromXML(String filepath){
 
-        XMLFile* file = GetSubsystem<Urho3D::ResourceCache>()->GetResource<Urho3D::XMLFile>(filepath);
-
-
-
-
-            Node* node = GetScene()->InstantiateXML(file->GetRoot(),Vector3::ZERO, Quaternion::IDENTITY);
+        Node* node=nullptr;
+        auto* prefabs = GetSubsystem<PrefabCache>();
+        if(prefabs)
+            node = prefabs->Instantiate(GetScene(), filepath, Vector3::ZERO, Quaternion::IDENTITY);
+        else{
+            XMLFile* file = GetSubsystem<Urho3D::ResourceCache>()->GetResource<Urho3D::XMLFile>(filepath);
+            if(file)
+                node = GetScene()->InstantiateXML(file->GetRoot(),Vector3::ZERO, Quaternion::IDENTITY);
+        }
 
             if(node)
             {
                 node->SetParent(selectedNode_);
+                history_->RecordCreateNode(node);
                 return true;
             }
         return false;
 
     }
 
+    /// Mouse Picking: the pick ray and its result are cached.
+    /// We only cast the ray again when the cursor or camera has moved, when the scene has changed
+    /// (see InvalidatePick), or when the object we hit has moved.
+    /// Objects which move by themselves into the path of the ray (ie crowd agents) are caught by a periodic refresh.
+    void InGameEditor::UpdatePick(const IntVector2& cursor, float dT){
+        auto* graphics = GetSubsystem<Graphics>();
+        auto* camera = EditorCameraNode_->GetComponent<Camera>();
+        pick_.age_ += dT;
+
+        IntVector2 screen(graphics->GetWidth(), graphics->GetHeight());
+        const Matrix3x4& view = camera->GetView();
+        Matrix4 projection = camera->GetProjection();
+
+        bool rayChanged = !pick_.valid_ || cursor!=pick_.cursor_ || screen!=pick_.screen_ || view!=pick_.view_ || projection!=pick_.projection_;
+        if(rayChanged){
+            pick_.cursor_     = cursor;
+            pick_.screen_     = screen;
+            pick_.view_       = view;
+            pick_.projection_ = projection;
+            pick_.ray_        = camera->GetScreenRay((float)cursor.x_ / screen.x_, (float)cursor.y_ / screen.y_);
+        }
+
+        bool targetMoved = pick_.hit_ && (!pick_.drawable_ || pick_.drawable_->GetNode()->GetWorldTransform()!=pick_.drawableTransform_);
+
+        if(pick_.valid_ && !rayChanged && !targetMoved && pick_.age_<pickRefreshInterval_)
+            return;
+
+        Drawable* hitDrawable=nullptr;
+        pick_.hit_      = Raycast(pick_.ray_, 50.0f, pick_.hitPos_, pick_.hitNormal_, hitDrawable);
+        pick_.drawable_ = hitDrawable;
+        if(hitDrawable)
+            pick_.drawableTransform_ = hitDrawable->GetNode()->GetWorldTransform();
+        pick_.valid_ = true;
+        pick_.age_   = 0;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////
+    /// Selection set
+
+    /// Apply one Inspector edit to every object in the selection set, in a single pass.
+    /// The Inspector shows the primary selection - for each other selected node, we edit its matching
+    /// object: the node itself, or its first component of the same type as the one being displayed.
+    /// Attribute indices are the same for every object of a given type, so the binding's index is reused.
+    /// The UI is refreshed, and E_EDITORSCENEMODIFIED is sent, once for the whole batch.
+    void InGameEditor::ApplyBatchEdit(const FieldBinding& binding, const String& text){
+        PruneSelection();
+
+        bool isVar = binding.index_==M_MAX_UNSIGNED;
+        bool isNode = isVar || binding.source_->IsInstanceOf<Node>();
+        StringHash componentType = isNode ? StringHash() : binding.source_->GetType();
+
+        FieldBinding target = binding;
+        Variant oldValue, value;
+        unsigned count=0;
+
+        /// The whole batch is one undo step
+        history_->BeginEdit();
+
+        for(unsigned i=0; i<selection_.Size(); i++){
+            Node* node = selection_[i];
+
+            /// The primary object might not be in the set (ie a component selected via the hierarchy)
+            Serializable* object = isNode ? static_cast<Serializable*>(node) : static_cast<Serializable*>(node->GetComponent(componentType));
+            if(!object || object==binding.source_)
+                continue;
+
+            target.source_ = object;
+            if(!isVar && target.index_ >= object->GetNumAttributes())
+                continue;
+            oldValue = GetBoundValue(target);
+            if(!ParseFieldValue(target, oldValue, text, value))
+                continue;
+
+            if(isVar){
+                node->SetVar(target.var_, value);
+                history_->AddVarDelta(node, target.var_, oldValue, value);
+            }else{
+                object->SetAttribute(target.index_, value);
+                history_->AddAttributeDelta(object, target.index_, oldValue, value);
+            }
+            count++;
+        }
+
+        /// ... and finally the object the Inspector is showing
+        oldValue = GetBoundValue(binding);
+        if(ParseFieldValue(binding, oldValue, text, value)){
+            if(isVar){
+                Node* node = static_cast<Node*>(binding.source_.Get());
+                node->SetVar(binding.var_, value);
+                history_->AddVarDelta(node, binding.var_, oldValue, value);
+            }else{
+                binding.source_->SetAttribute(binding.index_, value);
+                history_->AddAttributeDelta(binding.source_, binding.index_, oldValue, value);
+            }
+            count++;
+        }
+        history_->EndEdit();
+
+        SendSceneModified(count);
+        InvalidatePick();
+        UpdateInspector();
+    }
+
+    /// Step backwards or forwards through the edit history
+    void InGameEditor::UndoRedo(bool redo){
+        if(!(redo ? history_->Redo(GetScene()) : history_->Undo(GetScene())))
+            URHO3D_LOGWARNING(redo ? "Redo: nothing to redo, or could not be applied" : "Undo: nothing to undo, or could not be applied");
+
+        /// Undo may have deleted selected objects - our WeakPtrs take care of that
+        PruneSelection();
+        InvalidatePick();
+        SendSceneModified(1);
+        UpdateInspector();
+        SelectHierarchyItem();
+    }
+
+    /// Let anyone interested know the scene has been edited (once per edit, however many objects it touched)
+    void InGameEditor::SendSceneModified(unsigned count){
+        using namespace EditorSceneModified;
+        VariantMap& data = GetEventDataMap();
+        data[P_SCENE] = GetScene();
+        data[P_COUNT] = count;
+        SendEvent(E_EDITORSCENEMODIFIED, data);
+    }
+
+    /// Reset the selection set to just the primary selection
+    void InGameEditor::SelectSingle(){
+        selection_.Clear();
+        if(selectedNode_)
+            selection_.Push(selectedNode_);
+    }
+
+    /// Forget selected nodes which no longer exist
+    void InGameEditor::PruneSelection(){
+        for(unsigned i=0; i<selection_.Size();){
+            if(selection_[i])
+                i++;
+            else
+                selection_.Erase(i);
+        }
+    }
+
+    IntRect InGameEditor::GetMarqueeRect(const IntVector2& cursor) const {
+        return IntRect(Min(cursor.x_, marqueeStart_.x_), Min(cursor.y_, marqueeStart_.y_),
+                       Max(cursor.x_, marqueeStart_.x_), Max(cursor.y_, marqueeStart_.y_));
+    }
+
+    /// Track a marquee drag: it begins once the cursor has moved a few pixels with the left button held down
+    void InGameEditor::UpdateMarquee(const IntVector2& cursor){
+        if(!marqueePending_)
+            return;
+
+        /// Button was released somewhere we didn't hear about
+        if(!GetSubsystem<Input>()->GetMouseButtonDown(MOUSEB_LEFT)){
+            marqueePending_=marqueeActive_=false;
+            if(marqueeRect_)
+                marqueeRect_->SetVisible(false);
+            return;
+        }
+
+        IntVector2 drag = cursor - marqueeStart_;
+        if(!marqueeActive_ && Max(Abs(drag.x_), Abs(drag.y_)) < MARQUEE_MIN_DRAG)
+            return;
+        marqueeActive_=true;
+
+        if(!marqueeRect_){
+            /// Reuse the rectangle left by a previous instance (ie due to reload of scene containing editor component)
+            marqueeRect_ = (BorderImage*)uiRoot_->GetChild("MarqueeRect", false);
+            if(!marqueeRect_){
+                marqueeRect_ = new BorderImage(context_);
+                uiRoot_->AddChild(marqueeRect_);
+                marqueeRect_->SetName("MarqueeRect");
+                marqueeRect_->SetColor(Color(0.3f, 0.6f, 1.0f, 0.25f));
+                marqueeRect_->SetPriority(50);
+            }
+        }
+
+        IntRect rect = GetMarqueeRect(cursor);
+        marqueeRect_->SetPosition(rect.left_, rect.top_);
+        marqueeRect_->SetSize(rect.Width(), rect.Height());
+        marqueeRect_->SetVisible(true);
+    }
+
+    /// Compute the sub-frustum of the editor camera which lies behind a screen rectangle
+    bool InGameEditor::GetMarqueeFrustum(const IntRect& rect, Frustum& frustum){
+        auto* graphics = GetSubsystem<Graphics>();
+        auto* camera = EditorCameraNode_->GetComponent<Camera>();
+        float width  = (float)graphics->GetWidth();
+        float height = (float)graphics->GetHeight();
+
+        /// Rectangle in normalized device coordinates (+Y is up)
+        float x0 = 2.0f * rect.left_   / width  - 1.0f;
+        float x1 = 2.0f * rect.right_  / width  - 1.0f;
+        float y0 = 1.0f - 2.0f * rect.bottom_ / height;
+        float y1 = 1.0f - 2.0f * rect.top_    / height;
+        if(x1-x0 < M_EPSILON || y1-y0 < M_EPSILON)
+            return false;
+
+        /// Scale and offset clip space so the rectangle fills it - the result is the camera frustum, cropped
+        Matrix4 crop(2.0f/(x1-x0), 0.0f,         0.0f, -(x1+x0)/(x1-x0),
+                     0.0f,         2.0f/(y1-y0), 0.0f, -(y1+y0)/(y1-y0),
+                     0.0f,         0.0f,         1.0f, 0.0f,
+                     0.0f,         0.0f,         0.0f, 1.0f);
+        frustum.Define(crop * camera->GetProjection() * camera->GetView());
+        return true;
+    }
+
+    /// Marquee selection: a single frustum query against the Octree finds every drawable inside the rectangle
+    void InGameEditor::SetSelectionFromMarquee(const IntRect& rect, bool addToSelection){
+        Frustum frustum;
+        if(!GetMarqueeFrustum(rect, frustum))
+            return;
+
+        PODVector<Drawable*> drawables;
+        FrustumOctreeQuery query(drawables, frustum, DRAWABLE_GEOMETRY, EDITOR_QUERY_VIEWMASK);
+        GetScene()->GetComponent<Octree>()->GetDrawables(query);
+
+        if(addToSelection)
+            PruneSelection();
+        else
+            selection_.Clear();
+
+        /// A node may own several drawables - list each node once
+        HashSet<Node*> selectedNodes;
+        for(unsigned i=0; i<selection_.Size(); i++)
+            selectedNodes.Insert(selection_[i]);
+
+        Drawable* primary=nullptr;
+        for(unsigned i=0; i<drawables.Size(); i++){
+            Node* node = drawables[i]->GetNode();
+            if(selectedNodes.Contains(node))
+                continue;
+            selectedNodes.Insert(node);
+            selection_.Push(WeakPtr<Node>(node));
+            if(!primary)
+                primary=drawables[i];
+        }
+
+        if(primary){
+            selectedDrawable_  = primary;
+            selectedComponent_ = primary;
+            selectedNode_      = primary->GetNode();
+        }else if(!addToSelection){
+            selectedDrawable_  = nullptr;
+            selectedComponent_ = nullptr;
+            selectedNode_      = nullptr;
+        }
+
+        UpdateInspector();
+        SelectHierarchyItem();
+    }
+
+    /// Two-phase picking: a cheap RAY_AABB octree query collects candidates (sorted nearest first),
+    /// then only the nearest few get triangle tests - via a cached per-Model BVH for plain StaticModels,
+    /// or the drawable's own RAY_TRIANGLE test for anything else (ie animated or grouped models).
+    /// Candidates whose bounding box is farther away than our best hit so far can't win, so we stop there.
+    bool InGameEditor::RaycastTwoPhase(const Ray& ray, float maxDistance, Vector3& hitPos, Vector3& hitNormal, Drawable*& hitDrawable){
+        hitDrawable = nullptr;
+
+        PODVector<RayQueryResult> results;
+        RayOctreeQuery query(results, ray, RAY_AABB, maxDistance, DRAWABLE_GEOMETRY, EDITOR_QUERY_VIEWMASK);
+        GetScene()->GetComponent<Octree>()->Raycast(query);
+
+        float bestDistance = maxDistance;
+        unsigned tested = 0;
+
+        for(unsigned i=0; i<results.Size() && tested<(unsigned)pickCandidates_; i++){
+            if(results[i].distance_ >= bestDistance)
+                break;
+
+            Drawable* drawable = results[i].drawable_;
+            tested++;
+
+            if(drawable->GetType()==StaticModel::GetTypeStatic()){
+                ModelBVH* bvh = modelBVHs_->Get(static_cast<StaticModel*>(drawable)->GetModel());
+                if(bvh){
+                    /// Test in model space, then measure the distance in world space
+                    const Matrix3x4& world = drawable->GetNode()->GetWorldTransform();
+                    Ray localRay = ray.Transformed(world.Inverse());
+                    Vector3 localNormal;
+                    float localDistance = bvh->Raycast(localRay, M_INFINITY, &localNormal);
+                    if(localDistance < M_INFINITY){
+                        Vector3 worldPos = world * (localRay.origin_ + localRay.direction_ * localDistance);
+                        float distance = (worldPos - ray.origin_).Length();
+                        if(distance < bestDistance){
+                            bestDistance = distance;
+                            hitDrawable  = drawable;
+                            hitPos       = worldPos;
+                            /// Normals transform by the inverse transpose (handles non-uniform scale)
+                            hitNormal    = (world.Inverse().ToMatrix3().Transpose() * localNormal).Normalized();
+                        }
+                    }
+                    continue;
+                }
+            }
+
+            /// No BVH for this drawable - let it do its own triangle test
+            PODVector<RayQueryResult> triangleResults;
+            RayOctreeQuery triangleQuery(triangleResults, ray, RAY_TRIANGLE, bestDistance, DRAWABLE_GEOMETRY, EDITOR_QUERY_VIEWMASK);
+            drawable->ProcessRayQuery(triangleQuery, triangleResults);
+            for(unsigned j=0; j<triangleResults.Size(); j++){
+                if(triangleResults[j].distance_ < bestDistance){
+                    bestDistance = triangleResults[j].distance_;
+                    hitDrawable  = drawable;
+                    hitPos       = triangleResults[j].position_;
+                    hitNormal    = triangleResults[j].normal_;
+                }
+            }
+        }
+
+        return hitDrawable!=nullptr;
+    }
+
+    /// Something in the scene has changed - cast the pick ray again next frame
+    void InGameEditor::InvalidatePick(){
+        pick_.valid_ = false;
+    }
+
     /// Cast a Ray into the scene to detect drawable objects (via Octree Query)
     bool InGameEditor::Raycast(const Ray& ray, float maxDistance, Vector3& hitPos, Vector3& hitNormal, Drawable*& hitDrawable){
+        if(useTwoPhasePicking_)
+            return RaycastTwoPhase(ray, maxDistance, hitPos, hitNormal, hitDrawable);
+
         hitDrawable = nullptr;
 
         // Pick only geometry objects, not eg. zones or lights, only get the first (closest) hit
         PODVector<RayQueryResult> results;
-        RayOctreeQuery query(results, ray, RAY_TRIANGLE, maxDistance, DRAWABLE_GEOMETRY);
+        RayOctreeQuery query(results, ray, RAY_TRIANGLE, maxDistance, DRAWABLE_GEOMETRY, EDITOR_QUERY_VIEWMASK);
         GetScene()->GetComponent<Octree>()->RaycastSingle(query);
         if (results.Size())
         {
@@ -1436,6 +2180,9 @@
         Text* text = (Text*)list->GetSelectedItem();
         const String& bleh=text->GetText();
 
+        /// Scene files can be xml or binary
+        static const Vector<String> sceneFileFilters = {"*.xml", "*.bin", "*.*"};
+
         if(bleh=="Inspector")
         {
             InspectorIsVisible=!InspectorIsVisible;
@@ -1443,16 +2190,40 @@
         } else if(bleh=="Hierarchy") {
             HierarchyIsVisible=!HierarchyIsVisible;
             HierarchyWindow_->SetVisible(HierarchyIsVisible);
+        } else if(bleh=="Transform") {
+            /// Cycle the gizmo between Translate, Rotate and Scale
+            gizmo_->CycleMode();
+            URHO3D_LOGINFO("Transform Gizmo: "+gizmo_->GetModeName());
+        } else if(bleh=="Octree") {
+            drawOctree_=!drawOctree_;
+        } else if(bleh=="NavMesh") {
+            drawNavMesh_=!drawNavMesh_;
+        } else if(bleh=="Undo") {
+            UndoRedo(false);
+        } else if(bleh=="Redo") {
+            UndoRedo(true);
+        } else if(bleh=="Hierarchy Mode") {
+            /// Toggle between the regular and virtualized hierarchy views
+            useVirtualHierarchy_=!useVirtualHierarchy_;
+            ApplyHierarchyMode();
         } else if(bleh=="Load Scene") {
             if(fileSelector_)
                 delete fileSelector_;
             fileSelector_=CreateFileSelector("LOAD SCENE:");
+            fileSelector_->SetFilters(sceneFileFilters, 0);
             SubscribeToEvent(E_FILESELECTED, URHO3D_HANDLER(InGameEditor, HandleSceneLoadFileSelected));
         } else if(bleh=="Save Scene") {
             if(fileSelector_)
                 delete fileSelector_;
             fileSelector_=CreateFileSelector("SAVE SCENE:");
+            fileSelector_->SetFilters(sceneFileFilters, 0);
             SubscribeToEvent(E_FILESELECTED, URHO3D_HANDLER(InGameEditor, HandleSceneSaveFileSelected));
+        } else if(bleh=="Convert Scene") {
+            if(fileSelector_)
+                delete fileSelector_;
+            fileSelector_=CreateFileSelector("CONVERT SCENE (XML <-> BIN):");
+            fileSelector_->SetFilters(sceneFileFilters, 0);
+            SubscribeToEvent(E_FILESELECTED, URHO3D_HANDLER(InGameEditor, HandleSceneConvertFileSelected));
         } else if(bleh=="New Scene")
         {
 
@@ -1491,11 +2262,6 @@
         int btn = eventData[P_BUTTON].GetInt();
         if(btn==MOUSEB_LEFT)
         {
-            ListView* lv = (ListView*)HierarchyWindow_->GetChild("ListContent",false);
-
-            float vrange = lv->GetVerticalScrollBar()->GetRange();
-            float vpos = lv->GetVerticalScrollBar()->GetValue();
-
             if(!InspectorIsVisible){
                 InspectorIsVisible = true;
                 InspectorWindow_->SetVisible(true);
@@ -1507,11 +2273,9 @@
                 selectedNode_=GetScene()->GetNode(v.GetInt());
                 selectedComponent_=nullptr;
                 selectedDrawable_=selectedNode_->GetDerivedComponent<Drawable>();
-                RebuildInspector();
-                RebuildHierarchy( lv, GetScene());
-                // restore scroll position
-                lv->GetVerticalScrollBar()->SetRange(vrange);
-                lv->GetVerticalScrollBar()->SetValue(vpos);
+                SelectSingle();
+                UpdateInspector();
+                SelectHierarchyItem();
                 return;
             }
 
@@ -1521,11 +2285,9 @@
                 selectedComponent_=GetScene()->GetComponent(v.GetInt());
                 selectedNode_=selectedComponent_->GetNode();
                 selectedDrawable_=selectedNode_->GetDerivedComponent<Drawable>();
-                RebuildInspector();
-                RebuildHierarchy( lv, GetScene());
-                // restore scroll position
-                lv->GetVerticalScrollBar()->SetRange(vrange);
-                lv->GetVerticalScrollBar()->SetValue(vpos);
+                SelectSingle();
+                UpdateInspector();
+                SelectHierarchyItem();
                 return;
             }
         } else if(btn==MOUSEB_RIGHT){
@@ -1568,147 +2330,58 @@
         if(button->GetName()=="SpatialSystemToggleButton")
         {
             useLocalSpace=!useLocalSpace;
-            RebuildInspector();
+            UpdateInspector();
+        }
+        else if(button->GetName()=="LiveWatchToggleButton")
+        {
+            liveWatch_=!liveWatch_;
+            liveWatchTimer_=0;
+            UpdateInspector();
         }
     }
 
     /// User has pressed "enter" while editing a LineEdit element
+    /// We receive this event from every LineEdit - the ones we care about are found in our binding table
     void InGameEditor::HandleTextEditFinished(StringHash eventType, VariantMap& eventData){
         using namespace TextFinished;
         UIElement* element = (UIElement*)eventData[P_ELEMENT].GetPtr();
-        String text = eventData[P_TEXT].GetString();
-        float value = eventData[P_VALUE].GetFloat();
-
-        Variant t1 = element->GetVar("VarName");
-        if(t1.GetType()!=VAR_NONE){
-            Variant t2;
-            t2.FromString( (VariantType)element->GetVar("Type").GetInt(),text);
-            selectedNode_->SetVar( t1.GetString(), t2 );
-
-        } else {
-              t1 = element->GetVar("Attribute");
-              if(t1.GetType()!=VAR_NONE){
-
-                Serializable* source=(Serializable*)element->GetVar("Source").GetPtr();
-
-                VariantType type_ = (VariantType)element->GetVar("Type").GetInt();
-
-                if(type_==VAR_VECTOR2){
-
-                    Variant t2;
-                    t2.FromString( VAR_FLOAT,text);
-                    float fval=t2.GetFloat();
-
-                    Vector2 val = source->GetAttribute(t1.GetString()).GetVector2();
-
-                    const String& field = element->GetName();
-                    if(field=="X")
-                        val.x_ =fval;
-                    else if(field=="Y")
-                        val.y_ =fval;
-
-                    source->SetAttribute(t1.GetString(), Variant(val));
-
-                    RebuildInspector();
-
-                    return;
-
-                }
-
-                if(type_==VAR_VECTOR3){
-
-                    Variant t2;
-                    t2.FromString( VAR_FLOAT,text);
-                    float fval=t2.GetFloat();
-
-                    Vector3 val = source->GetAttribute(t1.GetString()).GetVector3();
-
-                    const String& field = element->GetName();
-                    if(field=="X")
-                        val.x_ =fval;
-                    else if(field=="Y")
-                        val.y_ =fval;
-                    else if(field=="Z")
-                        val.z_ =fval;
-
-                    source->SetAttribute(t1.GetString(), Variant(val));
-
-                    RebuildInspector();
-
-                    return;
-
-                }
-
-                if(type_==VAR_VECTOR4){
-
-                    Variant t2;
-                    t2.FromString( VAR_FLOAT,text);
-                    float fval=t2.GetFloat();
-
-                    Vector4 val = source->GetAttribute(t1.GetString()).GetVector4();
-
-                    const String& field = element->GetName();
-                    if(field=="X")
-                        val.x_ =fval;
-                    else if(field=="Y")
-                        val.y_ =fval;
-                    else if(field=="Z")
-                        val.z_ =fval;
-                    else if(field=="W")
-                        val.w_ =fval;
-                    source->SetAttribute(t1.GetString(), Variant(val));
-
-                    RebuildInspector();
-
-                    return;
-
-                }
-
-                if(type_==VAR_QUATERNION){
-                    Variant t2;
-                    t2.FromString( VAR_FLOAT,text);
-                    float fval=t2.GetFloat();
-
-                    Quaternion val = source->GetAttribute(t1.GetString()).GetQuaternion();
-
-                    const String& field = element->GetName();
-                    if(field=="X")
-                        val.x_ =fval;
-                    else if(field=="Y")
-                        val.y_ =fval;
-                    else if(field=="Z")
-                        val.z_ =fval;
-                    else if(field=="W")
-                        val.w_ =fval;
-
-                    source->SetAttribute(t1.GetString(), Variant(val));
-
-                    return;
-
-
-                }
-
-
-                /// Convert user plaintext into typed variant
-                Variant t2;
-                t2.FromString( (VariantType)element->GetVar("Type").GetInt(),text);
-                /// Store variant to named attribute
-                source->SetAttribute( t1.GetString(), t2 );
 
+        auto it = fieldBindings_.Find(element);
+        if(it==fieldBindings_.End())
+            return;
 
-                RebuildHierarchy( (ListView*)HierarchyWindow_->GetChild("ListContent",false), GetScene());
-                RebuildInspector();
+        const FieldBinding& binding = it->second_;
+        if(!binding.source_)
+            return;
 
+        const String& text = eventData[P_TEXT].GetString();
 
-              }else{
-                 /// We forgot to tag this ui element?
-                     int x=0;
+        /// With a multi-selection, the edit is applied to every selected object in one pass
+        if(selection_.Size()>1){
+            ApplyBatchEdit(binding, text);
+            return;
+        }
 
-              }
+        Variant oldValue = GetBoundValue(binding);
+        Variant value;
+        if(!ParseFieldValue(binding, oldValue, text, value))
+            return;
 
+        /// Store variant to the bound node var or attribute (and remember the change, for undo)
+        history_->BeginEdit();
+        if(binding.index_==M_MAX_UNSIGNED){
+            Node* node = static_cast<Node*>(binding.source_.Get());
+            node->SetVar(binding.var_, value);
+            history_->AddVarDelta(node, binding.var_, oldValue, value);
+        }else{
+            binding.source_->SetAttribute(binding.index_, value);
+            history_->AddAttributeDelta(binding.source_, binding.index_, oldValue, value);
         }
+        history_->EndEdit();
 
-        int x=0;
+        SendSceneModified(1);
+        InvalidatePick();
+        UpdateInspector();
     }
 
     /// The user has clicked on a "collapsing section" vertical divider
@@ -1723,7 +2396,7 @@
         else
             hideComponentAttribs=!hideComponentAttribs;
 
-        RebuildInspector();
+        UpdateInspector();
     }
 
      /// The user has selected a filename for loading the scene
@@ -1739,7 +2412,7 @@
 
             /// Attempt to load scene
             String filename = eventData[P_FILENAME].GetString();
-            ok=LoadSceneFromXML(filename);
+            ok=LoadSceneFromFile(filename);
 
             /// If attempt to load has failed, we'll relinquish ownership
             /// to ensure our fileselector is NOT destroyed when 's' goes out of scope
@@ -1768,7 +2441,7 @@
                 SetGlobalVar("FileSavePath",filename);
                 SubscribeToEvent(box, E_MESSAGEACK,URHO3D_HANDLER(InGameEditor, HandleSceneFileOverwriteAck));
             }else{
-                ok=SaveSceneToXML(filename);
+                ok=SaveSceneToFile(filename);
                 if(ok)
                    delete fileSelector_;
 
@@ -1781,6 +2454,22 @@
         int x=0;
     }
 
+    /// The user has selected a scene file to convert (xml -> binary, or binary -> xml)
+    /// The converted file is written next to the original, with the extension swapped
+    void InGameEditor::HandleSceneConvertFileSelected(StringHash eventType, VariantMap& eventData){
+        using namespace FileSelected;
+        bool ok = eventData[P_OK].GetBool();
+        if(ok){
+            String filename = eventData[P_FILENAME].GetString();
+            ok=ConvertSceneFile(context_, filename, GetSceneTwinPath(filename));
+            if(ok)
+                delete fileSelector_;
+        }
+        else{
+            delete fileSelector_;
+        }
+    }
+
      /// The user has selected a filename for loading the scene
     void InGameEditor::HandleNodeLoadFileSelected(StringHash eventType, VariantMap& eventData){
         using namespace FileSelected;
@@ -1796,8 +2485,7 @@
             {
                 delete fileSelector_;
 
-                RebuildInspector();
-                RebuildHierarchy( (ListView*)HierarchyWindow_->GetChild("ListContent",false), GetNode()->GetScene());
+                UpdateInspector();
             }
 
 
@@ -1839,7 +2527,7 @@
     void InGameEditor::HandleSceneFileOverwriteAck(StringHash eventType, VariantMap& eventData){
         using namespace MessageACK;
         if(eventData[P_OK].GetBool()==true){
-            bool ok=SaveSceneToXML(GetGlobalVar("FileSavePath").GetString());
+            bool ok=SaveSceneToFile(GetGlobalVar("FileSavePath").GetString());
             if(ok)
                 delete fileSelector_;
         }
@@ -1859,7 +2547,7 @@
          using namespace MessageACK;
         if(eventData[P_OK].GetBool()==true){
              String fullpath=GetSubsystem<FileSystem>()->GetProgramDir ()+"EmptyScene.xml" ;
-            bool ok=LoadSceneFromXML(fullpath);
+            bool ok=LoadSceneFromFile(fullpath);
         }
     }
 
@@ -1875,9 +2563,9 @@
         using namespace MessageACK;
         if(eventData[P_OK].GetBool()==true){
             if(deleteTargetComponent_){
+                history_->RecordDeleteComponent(deleteTargetComponent_);
                 deleteTargetComponent_->Remove();
-                RebuildHierarchy( (ListView*)HierarchyWindow_->GetChild("ListContent",false), GetNode()->GetScene());
-                RebuildInspector();
+                UpdateInspector();
             }
             nodeContextWindow_->Remove();
         }
@@ -1887,9 +2575,9 @@
         using namespace MessageACK;
         if(eventData[P_OK].GetBool()==true){
             if(deleteTargetNode_){
+                history_->RecordDeleteNode(deleteTargetNode_);
                 deleteTargetNode_->Remove();
-                RebuildHierarchy( (ListView*)HierarchyWindow_->GetChild("ListContent",false), GetNode()->GetScene());
-                RebuildInspector();
+                UpdateInspector();
             }
             nodeContextWindow_->Remove();
         }
@@ -1906,13 +2594,12 @@
 
             Node* node = (Node*)e->GetVar("ContextParentNode").GetPtr();
 
-            node->CreateComponent(name,mode);
+            history_->RecordCreateComponent(node->CreateComponent(name,mode));
 
             compContextWindow_->Remove();
             nodeContextWindow_->Remove();
 
-            RebuildHierarchy( (ListView*)HierarchyWindow_->GetChild("ListContent",false), GetNode()->GetScene());
-            RebuildInspector();
+            UpdateInspector();
 
         }
         int x=0;
@@ -2058,12 +2745,10 @@
 
         const String& name = button->GetName();
         if(name=="LocalNode"){
-            node->CreateChild("",LOCAL);
-            RebuildHierarchy( (ListView*)HierarchyWindow_->GetChild("ListContent",false), GetScene());
+            history_->RecordCreateNode(node->CreateChild("",LOCAL));
             nodeContextWindow_->Remove();
         }else if(name=="NetworkNode"){
-            node->CreateChild("",REPLICATED);
-            RebuildHierarchy( (ListView*)HierarchyWindow_->GetChild("ListContent",false), GetScene());
+            history_->RecordCreateNode(node->CreateChild("",REPLICATED));
             nodeContextWindow_->Remove();
 
         }else if(name=="DeleteComponent"){
@@ -2102,7 +2787,7 @@
             HierarchyWindow_->SetVisible(isVisible && HierarchyIsVisible);
 
             if(InspectorWindow_->IsVisible())
-                RebuildInspector();
+                UpdateInspector();
 
             /// Flipping mousecursor visibility !
             GetSubsystem<Input>()->SetMouseVisible(isVisible);
@@ -2113,13 +2798,53 @@
             if(selectedDrawable_)
                 characterNode_=selectedDrawable_->GetNode();
             break;
+
+        /// W, E, R = Translate, Rotate, Scale gizmo (while the editor menu is up - otherwise W flies the camera)
+        case KEY_W:
+        case KEY_E:
+        case KEY_R:
+            if(isVisible && !GetSubsystem<UI>()->GetFocusElement() && !(eventData[P_QUALIFIERS].GetInt() & QUAL_CTRL))
+                gizmo_->SetMode(key==KEY_W ? TransformGizmo::GIZMO_TRANSLATE : key==KEY_E ? TransformGizmo::GIZMO_ROTATE : TransformGizmo::GIZMO_SCALE);
+            break;
+
+        /// Ctrl+Z = Undo, Ctrl+Y (or Ctrl+Shift+Z) = Redo - unless the user is typing into a UI element
+        case KEY_Z:
+        case KEY_Y:{
+            int qualifiers = eventData[P_QUALIFIERS].GetInt();
+            if(!(qualifiers & QUAL_CTRL) || GetSubsystem<UI>()->GetFocusElement())
+                break;
+            UndoRedo(key==KEY_Y || (qualifiers & QUAL_SHIFT));
+            break;
+        }
         }
     }
 
     void InGameEditor::HandleMouseButtonDown(StringHash eventType, VariantMap& eventData){
         using namespace MouseButtonDown;
         int buttonID = eventData[P_BUTTON].GetInt();
-        if(buttonID==MOUSEB_MIDDLE )
+        if(buttonID==MOUSEB_LEFT)
+        {
+            /// Grab a gizmo handle, or maybe start a marquee drag - only over the scene (not UI), while the cursor is visible
+            auto* ui = GetSubsystem<UI>();
+            IntVector2 pos = ui->GetCursorPosition();
+            if(GetSubsystem<Input>()->IsMouseVisible() && !ui->GetElementAt(pos, true)){
+                if(gizmo_->IsHovering()){
+                    if(selection_.Empty())
+                        SelectSingle();
+                    gizmo_->BeginDrag(pick_.ray_, selection_);
+                }else{
+                    marqueePending_=true;
+                    marqueeStart_=pos;
+                }
+            }
+        }
+        else if(buttonID==MOUSEB_RIGHT && gizmo_->IsDragging())
+        {
+            /// Right-click while dragging puts everything back
+            gizmo_->CancelDrag();
+            InvalidatePick();
+        }
+        else if(buttonID==MOUSEB_MIDDLE )
         {
 
             if(!selectedNode_)
@@ -2139,7 +2864,24 @@
     void InGameEditor::HandleMouseButtonUp(StringHash eventType, VariantMap& eventData){
         using namespace MouseButtonUp;
         int buttonID = eventData[P_BUTTON].GetInt();
-        if(buttonID==MOUSEB_MIDDLE )
+        if(buttonID==MOUSEB_LEFT)
+        {
+            /// Finish a gizmo drag (one undo step for the whole selection)
+            if(gizmo_->IsDragging()){
+                gizmo_->EndDrag(history_);
+                InvalidatePick();
+                SendSceneModified(selection_.Size());
+                UpdateInspector();
+            }
+
+            /// Finish a marquee drag - hold Shift to add to the current selection
+            if(marqueeActive_)
+                SetSelectionFromMarquee(GetMarqueeRect(GetSubsystem<UI>()->GetCursorPosition()), GetSubsystem<Input>()->GetQualifierDown(QUAL_SHIFT));
+            marqueePending_=marqueeActive_=false;
+            if(marqueeRect_)
+                marqueeRect_->SetVisible(false);
+        }
+        else if(buttonID==MOUSEB_MIDDLE )
         {
             if(!selectedNode_)
                 return;
@@ -2175,73 +2917,87 @@
 
    ////////////////////////////////////////////////////////////////////////////////////
 
-    /// Post-Render event handler (DebugDrawing)
-    void InGameEditor::HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData){
-
+    /// Everything the editor overlay depends on, folded into one key
+    /// (selection boxes cost a bounding box read per selected node - still far cheaper than redrawing them)
+    unsigned InGameEditor::GetOverlayKey(){
+        OverlayKey key;
+        key.Add(EditorCameraNode_->GetWorldTransform());
+        key.Add(EditorCameraNode_->GetComponent<Camera>()->GetProjection());
+        key.Add(pick_.ray_);
+        key.Add(cursorOverUI_);
+        gizmo_->AddToKey(key);
+
+        key.Add(characterNode_.Get());
         if(!characterNode_)
-            return;
+            return key.Get();
+        key.Add(characterNode_->GetWorldTransform());
 
-        /// Obtain access to our "Box1" node
         Node* boxnode = GetScene()->GetChild("Box1");
+        if(boxnode)
+            key.Add(boxnode->GetWorldTransform());
 
-        /// Declare a variable to hold the world position of some Drawable
-        Vector3 drawPos;
-
-        /// Define a (buildtime) Macro to draw the local major axes of some Drawable
-        #define DrawMajorAxes(node, length, depthtest) \
-        if(node!=nullptr){\
-        drawPos = node->GetWorldPosition();\
-        const Vector3& scale = node->GetWorldScale();\
-        debugDraw_->AddLine(drawPos, node->LocalToWorld(Vector3::RIGHT   * length / scale.x_), Color(1, 0, 0, 1), depthtest);\
-        debugDraw_->AddLine(drawPos, node->LocalToWorld(Vector3::UP      * length / scale.y_), Color(0, 1, 0, 1), depthtest);\
-        debugDraw_->AddLine(drawPos, node->LocalToWorld(Vector3::FORWARD * length / scale.z_), Color(0, 0, 1, 1), depthtest);\
+        key.Add(candidateDrawable_.Get());
+        key.Add(candidateNormal_);
+        if(candidateDrawable_){
+            key.Add(candidateDrawable_->GetWorldBoundingBox());
+            key.Add(candidateDrawable_->GetNode()->GetRotation());
         }
 
-        /// Draw the major axes of our "Box1", and our current character
-        DrawMajorAxes(boxnode,        3.0f, true);
-        DrawMajorAxes(characterNode_, 3.0f, true);
-
-        /// Draw ORANGE the World AABB of the object currently underneath the mouse cursor
-        /// (unless its our current character...)
-        if(candidateDrawable_ && candidateDrawable_->GetNode()!=characterNode_){
-            debugDraw_->AddBoundingBox( candidateDrawable_->GetWorldBoundingBox(), Color(1,1,0), true);
-            candidateDrawable_->DrawDebugGeometry(debugDraw_,false);
-            //DrawMajorAxes(candidateDrawable_->GetNode(),3.0f, true);
+        key.Add(selectedDrawable_.Get());
+        if(selectedDrawable_)
+            key.Add(selectedDrawable_->GetWorldBoundingBox());
+
+        key.Add(selection_.Size());
+        if(selection_.Size()>1){
+            for(unsigned i=0; i<selection_.Size(); i++){
+                Node* node = selection_[i];
+                Drawable* drawable = node ? node->GetDerivedComponent<Drawable>() : nullptr;
+                key.Add(drawable);
+                if(drawable)
+                    key.Add(drawable->GetWorldBoundingBox());
+            }
         }
+        return key.Get();
+    }
 
-        /// Draw DARK GREEN the World AABB of the "currently selected object"
-        if(selectedDrawable_){
-            //debugDraw_->AddBoundingBox( selectedDrawable_->GetWorldBoundingBox(), Color(0,0.4f,0), true);
-//            selectedDrawable_->DrawDebugGeometry(debugDraw_,true);
-
-            /// Compute theoretical sphere radius for rotation gizmo
-            const BoundingBox& bb = selectedDrawable_->GetWorldBoundingBox();
+    /// Fill the retained overlay (see EditorOverlay.h)
+    void InGameEditor::BuildOverlay(){
 
-            Sphere s(bb);
-            float r = s.radius_;
+        /// Transform gizmo for the current selection
+        gizmo_->Draw(overlay_);
 
-            DrawMajorAxes(selectedDrawable_->GetNode(),r, true);
+        if(!characterNode_)
+            return;
 
+        /// Draw the major axes of our "Box1", and our current character
+        overlay_->AddMajorAxes(GetScene()->GetChild("Box1"), 3.0f, true);
+        overlay_->AddMajorAxes(characterNode_,               3.0f, true);
 
-            /// Draw three circles to represent the rotation axes of the selected entity
-            Node* n = selectedDrawable_->GetNode();
-            debugDraw_->AddCircle(n->GetWorldPosition(), n->GetWorldRight(), r, Color::RED, 32, false);
-            debugDraw_->AddCircle(n->GetWorldPosition(), n->GetWorldUp(),    r, Color::GREEN, 32, false);
-            debugDraw_->AddCircle(n->GetWorldPosition(), n->GetWorldDirection(), r, Color::BLUE, 32, false);
+        /// Draw ORANGE the World AABB of the object currently underneath the mouse cursor
+        /// (unless its our current character...)
+        if(candidateDrawable_ && candidateDrawable_->GetNode()!=characterNode_)
+            overlay_->AddBoundingBox( candidateDrawable_->GetWorldBoundingBox(), Color(1,1,0), true);
 
+        /// Draw DARK GREEN the World AABB of the "currently selected object"
+        /// (its axes and rotation rings are drawn by the transform gizmo)
+        if(selectedDrawable_)
+            overlay_->AddBoundingBox( selectedDrawable_->GetWorldBoundingBox(), Color(0,0.4f,0), true);
+
+        /// Draw DARK GREEN the World AABBs of the rest of the selection set
+        if(selection_.Size()>1){
+            for(unsigned i=0; i<selection_.Size(); i++){
+                Node* node = selection_[i];
+                Drawable* drawable = node ? node->GetDerivedComponent<Drawable>() : nullptr;
+                if(drawable && drawable!=selectedDrawable_)
+                    overlay_->AddBoundingBox(drawable->GetWorldBoundingBox(), Color(0,0.4f,0), true);
+            }
         }
 
-        // Debug-Draw the Octree
-        GetScene()->GetComponent<Octree>()->DrawDebugGeometry(debugDraw_, true);
+        if(cursorOverUI_)
+            return;
 
-        /// Create a Query Ray for MousePicking
-        /// This is redundant - we already did this in the Frame Update handler!
-        /// We should have cached our query ray...
-        auto* input=GetSubsystem<Input>();
-        IntVector2 pos=input->GetMousePosition();
-        auto* graphics = GetSubsystem<Graphics>();
-        auto* camera = EditorCameraNode_->GetComponent<Camera>();
-        Ray cameraRay = camera->GetScreenRay((float)pos.x_ / graphics->GetWidth(), (float)pos.y_ / graphics->GetHeight());
+        /// Our cached MousePicking query ray (see UpdatePick)
+        const Ray& cameraRay = pick_.ray_;
 
         /// Draw a Circle at the MouseCursor's projected world position...
         Vector3 Normal;
@@ -2257,13 +3013,36 @@
         }
 
         /// Draw a surface-oriented crosshair to represent the selection cursor
-        debugDraw_->AddCircle(cameraRay.origin_+cameraRay.direction_*0.1f, Normal, 0.005f, color, 32,false);
-        debugDraw_->AddCross(cameraRay.origin_+cameraRay.direction_*0.1f, candidateDrawable_?candidateDrawable_->GetNode()->GetRotation():EditorCameraNode_->GetRotation(), 0.005f, color,false);
+        overlay_->AddCircle(cameraRay.origin_+cameraRay.direction_*0.1f, Normal, 0.005f, color, 32,false);
+        overlay_->AddCross(cameraRay.origin_+cameraRay.direction_*0.1f, candidateDrawable_?candidateDrawable_->GetNode()->GetRotation():EditorCameraNode_->GetRotation(), 0.005f, color,false);
+    }
+
+    /// Post-Render event handler (DebugDrawing)
+    void InGameEditor::HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData){
+
+        /// Rebuild the retained overlay (axes, gizmo, cursor, selection boxes) only if something it shows has changed
+        if(overlay_->BeginRebuild(GetOverlayKey())){
+            BuildOverlay();
+            overlay_->EndRebuild();
+        }
+
+        if(!characterNode_)
+            return;
+
+        /// Debug geometry of the object currently underneath the mouse cursor (drawn by the object itself)
+        if(candidateDrawable_ && candidateDrawable_->GetNode()!=characterNode_)
+            candidateDrawable_->DrawDebugGeometry(debugDraw_,false);
+
+        /// Octree and navmesh views are toggled from the Tools menu, and only draw what the editor camera can see (see DebugViews.h)
+        auto* camera = EditorCameraNode_ ? EditorCameraNode_->GetComponent<Camera>() : nullptr;
+
+        // Debug-Draw the Octree
+        if(drawOctree_)
+            DrawOctreeCulled(GetScene()->GetComponent<Octree>(), debugDraw_, camera, debugDrawDistance_, true);
 
         /// DebugDraw the navmesh
-        auto* navmesh=GetScene()->GetComponent<DynamicNavigationMesh>();
-        if(navmesh)
-            navmesh->DrawDebugGeometry(debugDraw_, true);
+        if(drawNavMesh_)
+            DrawNavigationMeshCulled(GetScene()->GetComponent<DynamicNavigationMesh>(), debugDraw_, camera, debugDrawDistance_, true);
 
     }
 
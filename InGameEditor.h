@@ -1,6 +1,57 @@
 
+#include "VirtualTreeView.h"
+#include "ModelBVH.h"
+#include "EditorHistory.h"
+#include "EditorOverlay.h"
+#include "TransformGizmo.h"
+#include "DebugViews.h"
+
 using namespace Urho3D;
 
+/// Sent by the InGameEditor after the user has edited the scene (one event per edit, even for batch edits)
+URHO3D_EVENT(E_EDITORSCENEMODIFIED, EditorSceneModified)
+{
+    URHO3D_PARAM(P_SCENE, Scene);           // Scene pointer
+    URHO3D_PARAM(P_COUNT, Count);           // unsigned: number of objects changed
+}
+
+/// Binds an Inspector field (UI element) to (part of) the value it displays and edits
+struct FieldBinding{
+    WeakPtr<Serializable> source_;  /// Node or Component (the node, for node vars)
+    unsigned    index_;             /// Attribute index, or M_MAX_UNSIGNED for node vars
+    StringHash  var_;               /// Node var name (node vars only)
+    VariantType type_;              /// Type of the whole value
+    int         part_;              /// -1 for the whole value, or 0..3 for x,y,z,w
+};
+
+/// Cached mouse picking state: the pick ray, what it was computed from, and what it hit
+struct PickState{
+    bool        valid_=false;
+    IntVector2  cursor_;
+    IntVector2  screen_;
+    Matrix3x4   view_;
+    Matrix4     projection_;
+    Ray         ray_;
+    bool        hit_=false;
+    Vector3     hitPos_;
+    Vector3     hitNormal_;
+    WeakPtr<Drawable> drawable_;
+    Matrix3x4   drawableTransform_;
+    float       age_=0;         /// Seconds since the ray was last cast
+};
+
+/// A cached block of Inspector rows, for one type of Serializable (or for node vars)
+struct InspectorSection{
+    SharedPtr<UIElement>    root_;
+    PODVector<UIElement*>   fields_;        /// Bound fields (kept alive by root_)
+    /// Values of list-style attributes (rows which can't be refreshed in place)
+    Vector<Pair<unsigned, Variant>> listValues_;
+    /// The object the rows are currently bound to
+    WeakPtr<Serializable>   source_;
+    /// Layout signature (node vars only)
+    unsigned                signature_=0;
+};
+
 class InGameEditor:public LogicComponent
 {
     URHO3D_OBJECT(InGameEditor, LogicComponent);
@@ -29,11 +80,18 @@ public:
 private:
     float yaw_, pitch_;                             // Camera Orientation
 
-    bool useLocalSpace=false;                       // Not Implemented
+    bool useLocalSpace=false;                       // Transform gizmo axes follow the selected node
 
     bool isVisible=false;                           // Visibility: Main Menu
     bool HierarchyIsVisible=false;                  // Visibility: Scene Hierarchy
     bool InspectorIsVisible=false;                  // Visibility: Inspector
+    bool useVirtualHierarchy_=false;                // Scene Hierarchy uses the virtualized view
+    bool liveWatch_=false;                          // Inspector values are refreshed periodically
+    float liveWatchInterval_=0.1f;                  // Seconds between Live Watch refreshes
+    float liveWatchTimer_=0;
+
+    /// Scenes with more nodes than this start out with the virtualized hierarchy view
+    static const unsigned VIRTUAL_HIERARCHY_THRESHOLD = 2000;
 
     WeakPtr<DebugRenderer> debugDraw_;              // Support for debug-drawing
 
@@ -50,6 +108,19 @@ private:
     WeakPtr<Drawable>   candidateDrawable_;         // Drawable under the mousecursor
     Vector3             candidateNormal_;           // SurfaceNormal under the mousecursor
 
+    /// Selection set: every node we operate on in bulk (hierarchy, inspector).
+    /// selectedNode_ / selectedDrawable_ above are its "primary" member (the one the Inspector displays)
+    Vector<WeakPtr<Node>> selection_;
+
+    /// Marquee (drag-rectangle) selection state
+    bool                marqueePending_=false;      // Left button went down over the scene
+    bool                marqueeActive_=false;       // ... and the cursor has since moved far enough to drag a rectangle
+    IntVector2          marqueeStart_;
+    WeakPtr<BorderImage> marqueeRect_;              // Visual feedback (UI element)
+
+    /// Pixels the cursor must travel before a click turns into a marquee drag
+    static const int MARQUEE_MIN_DRAG = 4;
+
     WeakPtr<Node> characterNode_;                   // Root node for our "player character"
 
     IntVector2 InspectorPos_;                       // Screen position of these UI Windows
@@ -58,6 +129,24 @@ private:
     HashMap<String, Vector<String>> componentMap_;
 
 
+    /// Inspector rows, cached by type, so usually we only need to refresh the values they display
+    HashMap<StringHash, InspectorSection> inspectorSections_;
+    InspectorSection inspectorVars_;
+
+    /// Inspector layout elements
+    WeakPtr<Text>       inspectorNodeIDText_;
+    WeakPtr<Text>       inspectorNodeNameText_;
+    WeakPtr<Text>       inspectorSpaceText_;
+    WeakPtr<Text>       inspectorLiveWatchText_;
+    WeakPtr<UIElement>  inspectorVarsHolder_;
+    WeakPtr<UIElement>  inspectorNodeHolder_;
+    WeakPtr<UIElement>  inspectorComponentListHolder_;
+    WeakPtr<UIElement>  inspectorComponentHolder_;
+
+    /// What the Inspector's component list is currently showing
+    WeakPtr<Serializable> inspectorListSource_;
+    unsigned inspectorListCount_=0;
+
     /// State of Inspector "collapsing sections"
     bool hideVars=true, hideNodeAttribs=true, hideComponentAttribs=true;
 
@@ -97,7 +186,20 @@ private:
 
     ///////////////////////////////////////////////////////////////////////////////////////////
     /// Attribute Inspector Editor Window
-    void RebuildInspector();
+    void UpdateInspector();
+    void RefreshInspectorValues();
+    void CreateInspectorLayout(UIElement* panel);
+    UIElement* AddSectionHolder(UIElement* container);
+    bool ShowInspectorSection(UIElement* holder, Serializable* source, bool isNode);
+    void ScanInspectorFields(InspectorSection& section, Serializable* source, bool isVars=false);
+    void ForgetInspectorSection(InspectorSection& section);
+    void BindAttributeField(UIElement* element, Serializable* source, const AttributeInfo* info, int part=-1);
+    void BindVarField(UIElement* element, Node* node, StringHash var, VariantType type, int part=-1);
+
+    /// Inspector field bindings, by UI element - so each edit is dispatched with a single lookup
+    HashMap<UIElement*, FieldBinding> fieldBindings_;
+    bool RefreshInspectorSection(InspectorSection& section, Serializable* source);
+    static unsigned GetVarsSignature(const VariantMap& vars);
     void RebuildInspector_NodeVars(UIElement* panel);
     void RebuildInspector_NodeAttribs(UIElement* panel);
     void RebuildInspector_ComponentAttribs(UIElement* panel);
@@ -105,18 +207,73 @@ private:
     /////////////////////////////////////////////////////////////////////////////////////////////
     /// Scene Hierarchy Editor Window
     void CreateHierarchyWindow();
+    void ApplyHierarchyMode();
     void RebuildHierarchy(ListView* meh, Node* node, UIElement* parent=nullptr);
     void RebuildHierarchyRecursive(ListView* meh, Node* node, UIElement* parent=nullptr);
+    Text* AddHierarchyNodeItem(ListView* meh, Node* node, UIElement* parent);
+    Text* AddHierarchyComponentItem(ListView* meh, Component* comp, UIElement* parent, unsigned index=M_MAX_UNSIGNED);
+    void ForgetHierarchyItems(Node* node);
+    void SelectHierarchyItem();
+    ListView* GetHierarchyList();
+
+    /// Hierarchy ListView items, by Node / Component ID
+    HashMap<unsigned, WeakPtr<UIElement>> hierarchyNodeItems_;
+    HashMap<unsigned, WeakPtr<UIElement>> hierarchyComponentItems_;
+
+    /// Virtualized Scene Hierarchy view (see VirtualTreeView.h)
+    SharedPtr<VirtualTreeView> virtualHierarchy_;
 
     /////////////////////////////////////////////////////////////////////////////////////////////
     /// LOADING AND SAVING!
-    bool LoadSceneFromXML(String filepath);
-    bool SaveSceneToXML(String filepath);
+    /// Scene files may be xml or binary (".bin") - see SceneFile.h
+    bool LoadSceneFromFile(String filepath);
+    bool SaveSceneToFile(String filepath);
     bool LoadNodeFromXML(String filepath);
     bool SaveNodeToXML(String filepath);
     /////////////////////////////////////////////////////////////////////////////////////////////
 
     /// PickRay selection of Drawables
+    PickState pick_;
+    float pickRefreshInterval_=0.25f;               // Seconds before an unchanged pick is cast again anyway
+    bool cursorOverUI_=false;                       // The pick ray is not refreshed while the cursor is over a UI element
+    void UpdatePick(const IntVector2& cursor, float dT);
+    void InvalidatePick();
+
+    /// Selection set management
+    void SelectSingle();
+    void SetSelectionFromMarquee(const IntRect& rect, bool addToSelection);
+    bool GetMarqueeFrustum(const IntRect& rect, Frustum& frustum);
+    void UpdateMarquee(const IntVector2& cursor);
+    IntRect GetMarqueeRect(const IntVector2& cursor) const;
+    void PruneSelection();
+    void ApplyBatchEdit(const FieldBinding& binding, const String& text);
+    void SendSceneModified(unsigned count);
+
+    /// Undo / Redo (see EditorHistory.h)
+    SharedPtr<EditorHistory> history_;
+    int undoLevels_=100;                            // Max undo steps
+    int undoMemoryKB_=8192;                         // Approximate memory budget for the history
+    void UndoRedo(bool redo);
+
+    /// Translate / Rotate / Scale gizmo for the selection set (see TransformGizmo.h)
+    SharedPtr<TransformGizmo> gizmo_;
+
+    /// Retained overlay lines, rebuilt only when what they show has changed (see EditorOverlay.h)
+    SharedPtr<EditorOverlay> overlay_;
+    unsigned GetOverlayKey();
+    void BuildOverlay();
+
+    /// Debug views (Tools menu): octants and navmesh tiles, culled to the editor camera's frustum and draw distance
+    bool  drawOctree_=false;
+    bool  drawNavMesh_=false;
+    float debugDrawDistance_=100.0f;
+
+    /// Two-phase picking: AABB broadphase, then triangle tests on the nearest few candidates
+    bool useTwoPhasePicking_=true;
+    int  pickCandidates_=8;                         // Max candidates to triangle-test per pick
+    SharedPtr<ModelBVHCache> modelBVHs_;            // Per-Model triangle BVHs, built on demand
+    bool RaycastTwoPhase(const Ray& ray, float maxDistance, Vector3& hitPos, Vector3& hitNormal, Drawable*& hitDrawable);
+
     bool Raycast(const Ray& ray, float maxDistance, Vector3& hitPos, Vector3& hitNormal, Drawable*& hitDrawable);
 
     /// Implements "free-look" camera behaviour
@@ -135,6 +292,7 @@ private:
     void HandleCollapsingSection(     StringHash eventType, VariantMap& eventData);
     void HandleSceneLoadFileSelected( StringHash eventType, VariantMap& eventData);
     void HandleSceneSaveFileSelected( StringHash eventType, VariantMap& eventData);
+    void HandleSceneConvertFileSelected(StringHash eventType, VariantMap& eventData);
     void HandleNodeLoadFileSelected(  StringHash eventType, VariantMap& eventData);
     void HandleNodeSaveFileSelected(  StringHash eventType, VariantMap& eventData);
     void HandleContextButtonClick(    StringHash eventType, VariantMap& eventData);
@@ -156,6 +314,13 @@ private:
     void HandleMouseButtonDown(       StringHash eventType, VariantMap& eventData);
     void HandleMouseButtonUp(         StringHash eventType, VariantMap& eventData);
 
+    /// Scene Event Handling (keeps the Hierarchy up to date):
+    void HandleSceneNodeAdded(        StringHash eventType, VariantMap& eventData);
+    void HandleSceneNodeRemoved(      StringHash eventType, VariantMap& eventData);
+    void HandleSceneComponentAdded(   StringHash eventType, VariantMap& eventData);
+    void HandleSceneComponentRemoved( StringHash eventType, VariantMap& eventData);
+    void HandleSceneNodeNameChanged(  StringHash eventType, VariantMap& eventData);
+
     /// Post-Render event handler (DebugDrawing)
     void HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData);
 
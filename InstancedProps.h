@@ -0,0 +1,232 @@
+#pragma once
+
+using namespace Urho3D;
+
+/// Many copies of one model (props: crates, rocks, debris...) rendered through a single Drawable.
+/// Instance transforms live in a packed array, relative to our node - there is no Node, Component
+/// or Octree entry per instance, so tens of thousands of props cost no more scene-graph and culling
+/// work than a single StaticModel. The renderer batches all instances into one instanced draw call
+/// (per geometry), exactly like it does for StaticModelGroup.
+/// The Octree culls the whole set as one unit - to cull a large field of props piece by piece,
+/// split it over several InstancedProps nodes (ie one per area).
+/// Ray queries report the nearest instance hit, with its index in RayQueryResult::subObject_.
+class InstancedProps:public StaticModel
+{
+    URHO3D_OBJECT(InstancedProps, StaticModel);
+public:
+    static void RegisterObject(Context* context){
+        context->RegisterFactory<InstancedProps>();
+        URHO3D_COPY_BASE_ATTRIBUTES(StaticModel);
+        URHO3D_MIXED_ACCESSOR_ATTRIBUTE("Instances", GetInstancesAttr, SetInstancesAttr, PODVector<unsigned char>, Variant::emptyBuffer, AM_FILE | AM_NOEDIT);
+    }
+
+    InstancedProps(Context* context):StaticModel(context) { }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////
+    /// Instances (transforms are relative to our node)
+
+    unsigned AddInstance(const Vector3& position, const Quaternion& rotation=Quaternion::IDENTITY, const Vector3& scale=Vector3::ONE){
+        transforms_.Push(Matrix3x4(position, rotation, scale));
+        InstancesChanged();
+        return transforms_.Size()-1;
+    }
+
+    void SetInstance(unsigned index, const Matrix3x4& transform){
+        if(index>=transforms_.Size())
+            return;
+        transforms_[index] = transform;
+        InstancesChanged();
+    }
+
+    /// Removal moves the last instance into the freed slot (so its index changes)
+    void RemoveInstance(unsigned index){
+        if(index>=transforms_.Size())
+            return;
+        transforms_[index] = transforms_.Back();
+        transforms_.Pop();
+        InstancesChanged();
+    }
+
+    void ClearInstances(){
+        transforms_.Clear();
+        InstancesChanged();
+    }
+
+    /// Reserve room before adding lots of instances
+    void ReserveInstances(unsigned count) { transforms_.Reserve(count); }
+
+    unsigned GetNumInstances() const { return transforms_.Size(); }
+    const Matrix3x4& GetInstanceTransform(unsigned index) const { return transforms_[index]; }
+
+    Matrix3x4 GetInstanceWorldTransform(unsigned index) const {
+        return node_ ? node_->GetWorldTransform() * transforms_[index] : transforms_[index];
+    }
+
+    /// Nearest instance (triangle-accurate) hit by a world-space ray - returns M_MAX_UNSIGNED if none
+    unsigned PickInstance(const Ray& ray, float maxDistance=M_INFINITY, Vector3* hitPos=nullptr, Vector3* hitNormal=nullptr){
+        RayQueryResult result;
+        if(!RaycastInstances(ray, maxDistance, RAY_TRIANGLE, result))
+            return M_MAX_UNSIGNED;
+        if(hitPos)
+            *hitPos = result.position_;
+        if(hitNormal)
+            *hitNormal = result.normal_;
+        return result.subObject_;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////
+    /// Drawable overrides
+
+    void ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQueryResult>& results) override {
+        RayQueryResult result;
+        if(RaycastInstances(query.ray_, query.maxDistance_, query.level_, result))
+            results.Push(result);
+    }
+
+    void UpdateBatches(const FrameInfo& frame) override {
+        /// Getting the world bounding box ensures the world transforms are up to date
+        const BoundingBox& worldBoundingBox = GetWorldBoundingBox();
+        distance_ = frame.camera_->GetDistance(worldBoundingBox.Center());
+
+        for(unsigned i=0; i<batches_.Size(); i++){
+            batches_[i].distance_ = distance_;
+            batches_[i].worldTransform_ = worldTransforms_.Size() ? &worldTransforms_[0] : &Matrix3x4::IDENTITY;
+            batches_[i].numWorldTransforms_ = worldTransforms_.Size();
+        }
+
+        float scale = worldBoundingBox.Size().DotProduct(DOT_SCALE);
+        float newLodDistance = frame.camera_->GetLodDistance(distance_, scale, lodBias_);
+        if(newLodDistance!=lodDistance_){
+            lodDistance_ = newLodDistance;
+            CalculateLodLevels();
+        }
+    }
+
+    /// Instances are not fed to the occlusion buffer
+    unsigned GetNumOccluderTriangles() override { return 0; }
+
+    /// Navigation mesh builds only know our node's transform, not the instance transforms -
+    /// so we provide no navigation geometry at all (props are decoration, agents walk through them)
+    Geometry* GetLodGeometry(unsigned batchIndex, unsigned level) override { return nullptr; }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////
+    /// Serialization: instance count, then the packed transforms (compressed in xml scene files - see SceneFile.h)
+
+    void SetInstancesAttr(const PODVector<unsigned char>& value){
+        MemoryBuffer buffer(value);
+        unsigned count = buffer.IsEof() ? 0 : buffer.ReadVLE();
+        if(count * sizeof(Matrix3x4) > buffer.GetSize() - buffer.GetPosition()){
+            URHO3D_LOGERROR("InstancedProps: truncated instance data");
+            count = 0;
+        }
+        transforms_.Resize(count);
+        if(count)
+            buffer.Read(&transforms_[0], count * sizeof(Matrix3x4));
+        InstancesChanged();
+    }
+
+    PODVector<unsigned char> GetInstancesAttr() const {
+        VectorBuffer buffer;
+        buffer.WriteVLE(transforms_.Size());
+        if(transforms_.Size())
+            buffer.Write(&transforms_[0], transforms_.Size() * sizeof(Matrix3x4));
+        return buffer.GetBuffer();
+    }
+
+protected:
+
+    /// Recompute world transforms and boxes (only when our node moves, or the instances change)
+    void OnWorldBoundingBoxUpdate() override {
+        const Matrix3x4& world = node_->GetWorldTransform();
+        unsigned count = transforms_.Size();
+        worldTransforms_.Resize(count);
+        worldBoxes_.Resize(count);
+
+        worldBoundingBox_.Clear();
+        for(unsigned i=0; i<count; i++){
+            worldTransforms_[i] = world * transforms_[i];
+            worldBoxes_[i] = boundingBox_.Transformed(worldTransforms_[i]);
+            worldBoundingBox_.Merge(worldBoxes_[i]);
+        }
+        if(!count)
+            worldBoundingBox_.Define(node_->GetWorldPosition());
+    }
+
+private:
+
+    void InstancesChanged(){
+        if(node_)
+            OnMarkedDirty(node_);
+    }
+
+    /// Nearest instance hit: broadphase on the instance world boxes, then the requested level of detail
+    bool RaycastInstances(const Ray& ray, float maxDistance, RayQueryLevel level, RayQueryResult& result){
+        if(!node_ || transforms_.Empty() || ray.HitDistance(GetWorldBoundingBox()) >= maxDistance)
+            return false;
+
+        float bestDistance = maxDistance;
+        unsigned bestIndex = M_MAX_UNSIGNED;
+        Vector3 bestNormal;
+
+        for(unsigned i=0; i<worldBoxes_.Size(); i++){
+            float distance = ray.HitDistance(worldBoxes_[i]);
+            if(distance >= bestDistance)
+                continue;
+
+            if(level==RAY_AABB){
+                bestDistance = distance;
+                bestIndex = i;
+                bestNormal = -ray.direction_;
+                continue;
+            }
+
+            /// Test in instance space, then measure the distance in world space
+            const Matrix3x4& world = worldTransforms_[i];
+            Ray localRay = ray.Transformed(world.Inverse());
+            float localDistance = M_INFINITY;
+            Vector3 localNormal = -localRay.direction_;
+
+            if(level==RAY_OBB)
+                localDistance = localRay.HitDistance(boundingBox_);
+            else{
+                for(unsigned j=0; j<batches_.Size(); j++){
+                    Geometry* geometry = batches_[j].geometry_;
+                    if(!geometry)
+                        continue;
+                    Vector3 geometryNormal;
+                    float geometryDistance = geometry->GetHitDistance(localRay, &geometryNormal);
+                    if(geometryDistance < localDistance){
+                        localDistance = geometryDistance;
+                        localNormal = geometryNormal;
+                    }
+                }
+            }
+
+            if(localDistance < M_INFINITY){
+                distance = (world * (localRay.origin_ + localRay.direction_ * localDistance) - ray.origin_).Length();
+                if(distance < bestDistance){
+                    bestDistance = distance;
+                    bestIndex = i;
+                    bestNormal = (world * Vector4(localNormal, 0.0f)).Normalized();
+                }
+            }
+        }
+
+        if(bestIndex==M_MAX_UNSIGNED)
+            return false;
+
+        result.position_  = ray.origin_ + ray.direction_ * bestDistance;
+        result.normal_    = bestNormal;
+        result.distance_  = bestDistance;
+        result.drawable_  = this;
+        result.node_      = node_;
+        result.subObject_ = bestIndex;
+        return true;
+    }
+
+    /// Instance transforms, relative to our node (this is what gets saved)
+    PODVector<Matrix3x4>    transforms_;
+    /// World transforms and bounds of each instance, refreshed with our world bounding box
+    PODVector<Matrix3x4>    worldTransforms_;
+    PODVector<BoundingBox>  worldBoxes_;
+};
@@ -0,0 +1,240 @@
+#pragma once
+
+using namespace Urho3D;
+
+/// Bounding Volume Hierarchy over the triangles of a Model (LOD 0 of every geometry), in model space.
+/// Used for cheap ray-triangle picking on detailed models: instead of testing every triangle,
+/// the ray only visits the boxes it passes through, nearest first.
+/// Built once per Model (see ModelBVHCache), from the CPU-side copy of the vertex and index data.
+class ModelBVH:public RefCounted
+{
+    /// BVH node: leaf nodes own a range of triangles,
+    /// internal nodes have their left child immediately after them, and the right child at right_
+    struct BVHNode{
+        BoundingBox box_;
+        unsigned    first_;     /// First triangle (leaf nodes)
+        unsigned    count_;     /// Number of triangles - zero for internal nodes
+        unsigned    right_;     /// Index of right child (internal nodes)
+    };
+
+    /// Triangles per leaf node
+    static const unsigned LEAF_SIZE = 4;
+    /// Deepest tree we'll build (bounds our traversal stack)
+    static const unsigned MAX_DEPTH = 40;
+
+public:
+
+    /// Build the BVH for a Model - returns false if the model has no usable CPU-side geometry data
+    bool Build(Model* model){
+        triangles_.Clear();
+        nodes_.Clear();
+
+        for(unsigned g=0; g<model->GetNumGeometries(); g++){
+            Geometry* geom = model->GetGeometry(g, 0);
+            if(!geom || geom->GetPrimitiveType()!=TRIANGLE_LIST)
+                continue;
+
+            const unsigned char* vertexData;
+            const unsigned char* indexData;
+            unsigned vertexSize, indexSize;
+            const PODVector<VertexElement>* elements;
+            geom->GetRawData(vertexData, vertexSize, indexData, indexSize, elements);
+            if(!vertexData || !vertexSize || !elements)
+                continue;
+
+            unsigned posOffset = VertexBuffer::GetElementOffset(*elements, TYPE_VECTOR3, SEM_POSITION);
+            if(posOffset==M_MAX_UNSIGNED)
+                continue;
+
+            #define VERTEX_POSITION(index) (*(const Vector3*)(vertexData + (index)*vertexSize + posOffset))
+
+            if(indexData){
+                unsigned start = geom->GetIndexStart();
+                unsigned end   = start + geom->GetIndexCount();
+                for(unsigned i=start; i+2<end; i+=3){
+                    for(unsigned k=0; k<3; k++){
+                        unsigned index = indexSize==sizeof(unsigned short) ? ((const unsigned short*)indexData)[i+k] : ((const unsigned*)indexData)[i+k];
+                        triangles_.Push(VERTEX_POSITION(index));
+                    }
+                }
+            }else{
+                unsigned start = geom->GetVertexStart();
+                unsigned end   = start + geom->GetVertexCount();
+                for(unsigned i=start; i+2<end; i+=3){
+                    triangles_.Push(VERTEX_POSITION(i));
+                    triangles_.Push(VERTEX_POSITION(i+1));
+                    triangles_.Push(VERTEX_POSITION(i+2));
+                }
+            }
+
+            #undef VERTEX_POSITION
+        }
+
+        unsigned numTriangles = triangles_.Size()/3;
+        if(!numTriangles)
+            return false;
+
+        centroids_.Resize(numTriangles);
+        for(unsigned i=0; i<numTriangles; i++)
+            centroids_[i] = (triangles_[i*3] + triangles_[i*3+1] + triangles_[i*3+2]) / 3.0f;
+
+        nodes_.Reserve(numTriangles/LEAF_SIZE*2+1);
+        BuildRecursive(0, numTriangles, 0);
+
+        /// Centroids are only needed while building
+        centroids_.Clear();
+        centroids_.Compact();
+        return true;
+    }
+
+    /// Cast a model-space ray against the triangles - returns hit distance, or M_INFINITY on a miss
+    /// As with RAY_TRIANGLE octree queries, only front faces are hit
+    float Raycast(const Ray& ray, float maxDistance, Vector3* outNormal=nullptr) const {
+        if(nodes_.Empty())
+            return M_INFINITY;
+
+        float best = maxDistance;
+        bool hit = false;
+        Vector3 bestNormal;
+
+        unsigned stack[MAX_DEPTH+2];
+        unsigned sp=0;
+        stack[sp++]=0;
+
+        while(sp){
+            unsigned index = stack[--sp];
+            const BVHNode& node = nodes_[index];
+            if(ray.HitDistance(node.box_) >= best)
+                continue;
+
+            if(node.count_){
+                for(unsigned t=node.first_; t<node.first_+node.count_; t++){
+                    Vector3 normal;
+                    float d = ray.HitDistance(triangles_[t*3], triangles_[t*3+1], triangles_[t*3+2], &normal);
+                    if(d<best){
+                        best=d;
+                        bestNormal=normal;
+                        hit=true;
+                    }
+                }
+            }else{
+                /// Visit the nearer child first, so we can skip more of the farther one
+                unsigned left = index+1, right = node.right_;
+                float dl = ray.HitDistance(nodes_[left].box_);
+                float dr = ray.HitDistance(nodes_[right].box_);
+                if(dl<dr){
+                    stack[sp++]=right;
+                    stack[sp++]=left;
+                }else{
+                    stack[sp++]=left;
+                    stack[sp++]=right;
+                }
+            }
+        }
+
+        if(!hit)
+            return M_INFINITY;
+        if(outNormal)
+            *outNormal = bestNormal.Normalized();
+        return best;
+    }
+
+    unsigned GetNumTriangles() const { return triangles_.Size()/3; }
+
+private:
+
+    /// Build the subtree for triangles [first, first+count) - returns the node index
+    unsigned BuildRecursive(unsigned first, unsigned count, unsigned depth){
+        unsigned index = nodes_.Size();
+        nodes_.Resize(index+1);
+
+        BoundingBox box, centroidBox;
+        for(unsigned t=first; t<first+count; t++){
+            box.Merge(triangles_[t*3]);
+            box.Merge(triangles_[t*3+1]);
+            box.Merge(triangles_[t*3+2]);
+            centroidBox.Merge(centroids_[t]);
+        }
+        nodes_[index].box_ = box;
+
+        if(count<=LEAF_SIZE || depth>=MAX_DEPTH){
+            nodes_[index].first_ = first;
+            nodes_[index].count_ = count;
+            nodes_[index].right_ = 0;
+            return index;
+        }
+
+        /// Split at the middle of the longest axis of the centroid bounds
+        Vector3 size = centroidBox.Size();
+        int axis = (size.x_>=size.y_ && size.x_>=size.z_) ? 0 : (size.y_>=size.z_ ? 1 : 2);
+        float split = centroidBox.Center().Data()[axis];
+
+        unsigned mid = first;
+        for(unsigned t=first; t<first+count; t++){
+            if(centroids_[t].Data()[axis] < split){
+                SwapTriangles(t, mid);
+                mid++;
+            }
+        }
+
+        /// All centroids on one side (ie lots of identical triangles) - just split the range in half
+        if(mid==first || mid==first+count)
+            mid = first + count/2;
+
+        nodes_[index].first_ = first;
+        nodes_[index].count_ = 0;
+        BuildRecursive(first, mid-first, depth+1);
+        unsigned right = BuildRecursive(mid, first+count-mid, depth+1);
+        nodes_[index].right_ = right;
+        return index;
+    }
+
+    void SwapTriangles(unsigned a, unsigned b){
+        if(a==b)
+            return;
+        for(unsigned k=0; k<3; k++)
+            Swap(triangles_[a*3+k], triangles_[b*3+k]);
+        Swap(centroids_[a], centroids_[b]);
+    }
+
+    /// Triangle vertex positions, three per triangle, ordered so each leaf owns a contiguous range
+    PODVector<Vector3> triangles_;
+    PODVector<Vector3> centroids_;
+    PODVector<BVHNode> nodes_;
+};
+
+/// Lazily built ModelBVH per Model
+class ModelBVHCache:public RefCounted
+{
+public:
+    /// Return the BVH for a Model, building it if needed - returns null if the model can't be used
+    ModelBVH* Get(Model* model){
+        if(!model)
+            return nullptr;
+
+        auto it = entries_.Find(model);
+        if(it!=entries_.End()){
+            /// Make sure this is the same model, not a new one which happens to live at the same address
+            if(it->second_.model_==model)
+                return it->second_.bvh_;
+            entries_.Erase(it);
+        }
+
+        Entry entry;
+        entry.model_ = model;
+        entry.bvh_ = new ModelBVH();
+        if(!entry.bvh_->Build(model))
+            entry.bvh_.Reset();
+        entries_[model] = entry;
+        return entry.bvh_;
+    }
+
+    void Clear() { entries_.Clear(); }
+
+private:
+    struct Entry{
+        WeakPtr<Model>      model_;
+        SharedPtr<ModelBVH> bvh_;
+    };
+    HashMap<Model*, Entry> entries_;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "NavTileBuilder.h"
+
+using namespace Urho3D;
+
+/// Headless navmesh build benchmark: rebuilds a scene's DynamicNavigationMesh from scratch, first serially
+/// (DynamicNavigationMesh::Build), then in parallel (NavTileBuilder::BuildAll) over the WorkQueue threads,
+/// and prints the build time of each. Each build is run a few times, and the best time is reported.
+/// The WorkQueue's thread count is fixed for the life of the process, so build time vs thread count is
+/// measured by running once per thread count ("-navbenchmark <workers>" - MyApp creates that many worker threads).
+/// Within a run, the parallel build is also timed with a limit on the tiles in flight: the tiles are then built
+/// in batches of that size, with a wait at the end of each batch - that shows how well the tiles spread over the
+/// threads we have, it does not change the number of threads.
+class NavBuildBenchmark:public Object
+{
+    URHO3D_OBJECT(NavBuildBenchmark, Object);
+
+    /// Builds timed per configuration
+    static const unsigned RUNS = 3;
+
+public:
+    NavBuildBenchmark(Context* context):Object(context) { }
+
+    void Run(Scene* scene){
+        auto* navmesh = scene->GetComponent<DynamicNavigationMesh>(true);
+        if(!navmesh){
+            PrintLine("Nav build benchmark: the scene has no DynamicNavigationMesh");
+            return;
+        }
+        unsigned workers = GetSubsystem<WorkQueue>()->GetNumThreads();
+
+        /// Serial baseline
+        float serial = M_INFINITY;
+        for(unsigned run=0; run<RUNS; run++){
+            HiresTimer timer;
+            if(!navmesh->Build()){
+                PrintLine("Nav build benchmark: the navigation mesh failed to build");
+                return;
+            }
+            serial = Min(serial, timer.GetUSec(false) / 1000.0f);
+        }
+        IntVector2 numTiles = navmesh->GetNumTiles();
+        PrintLine("Nav build benchmark: "+String(numTiles.x_ * numTiles.y_)+" tiles, "+String(workers)+" worker threads (plus the main thread)");
+        PrintLine("  serial Build(): "+String(serial)+" ms");
+
+        /// Parallel, every tile in flight at once - the figure to compare between runs with different thread counts
+        SharedPtr<NavTileBuilder> builder(new NavTileBuilder(context_));
+        float parallel = TimeBuildAll(builder, navmesh, 0);
+        if(parallel<0.0f)
+            return;
+        PrintLine("  BuildAll(), "+String(workers)+" workers: "+String(parallel)+" ms, "+String(serial / parallel)+"x vs serial");
+
+        /// Parallel, by tiles in flight (batch size)
+        for(unsigned inFlight=1; inFlight<=workers+1; inFlight++){
+            float best = TimeBuildAll(builder, navmesh, inFlight);
+            if(best<0.0f)
+                return;
+            PrintLine("  BuildAll(), "+String(inFlight)+" tile(s) in flight: "+String(best)+" ms, "+String(serial / best)+"x vs serial");
+        }
+    }
+
+private:
+
+    /// Best time of a few parallel builds, in ms (negative on failure)
+    float TimeBuildAll(NavTileBuilder* builder, DynamicNavigationMesh* navmesh, unsigned maxConcurrent){
+        float best = M_INFINITY;
+        for(unsigned run=0; run<RUNS; run++){
+            HiresTimer timer;
+            if(!builder->BuildAll(navmesh, maxConcurrent)){
+                PrintLine("Nav build benchmark: the parallel build failed");
+                return -1.0f;
+            }
+            best = Min(best, timer.GetUSec(false) / 1000.0f);
+        }
+        return best;
+    }
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "NavTileBuilder.h"
+
+using namespace Urho3D;
+
+/// Keeps a DynamicNavigationMesh current while the level is edited (in the InGameEditor, or by the game).
+/// We track every StaticModel which the navmesh is built from (nodes under a Navigable, except crowd agents):
+/// when one is moved, added or removed, the tiles under its old and new bounding boxes are marked dirty,
+/// and only those tiles are rebuilt - on worker threads, and swapped in a few per frame (see NavTileBuilder).
+/// Moves are seen through node listeners (no polling). A node being dragged around is only rebuilt once it has
+/// been still for a moment, rather than on every frame of the drag.
+class NavMeshUpdater:public LogicComponent
+{
+    URHO3D_OBJECT(NavMeshUpdater, LogicComponent);
+
+    struct TrackedNode{
+        WeakPtr<Node>   node_;
+        BoundingBox     box_;       /// World bounding box the navmesh was last built with
+    };
+
+public:
+    static void RegisterObject(Context* context){
+        context->RegisterFactory<NavMeshUpdater>();
+        URHO3D_ATTRIBUTE("Update Budget Ms", float, updateBudgetMs_, 2.0f, AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Settle Time", float, settleTime_, 0.25f, AM_DEFAULT);
+        URHO3D_ATTRIBUTE("Max Tiles Per Frame", int, maxTilesPerFrame_, 4, AM_DEFAULT);
+    }
+
+    NavMeshUpdater(Context* context):LogicComponent(context) {
+        SetUpdateEventMask(USE_POSTUPDATE);
+    }
+
+    virtual void DelayedStart(){
+        Scene* scene = GetScene();
+        navmesh_ = scene->GetComponent<DynamicNavigationMesh>(true);
+        builder_ = new NavTileBuilder(context_);
+
+        TrackSubtree(scene, false);
+
+        SubscribeToEvent(scene, E_NODEADDED,        URHO3D_HANDLER(NavMeshUpdater, HandleNodeAdded));
+        SubscribeToEvent(scene, E_NODEREMOVED,      URHO3D_HANDLER(NavMeshUpdater, HandleNodeRemoved));
+        SubscribeToEvent(scene, E_COMPONENTADDED,   URHO3D_HANDLER(NavMeshUpdater, HandleComponentAdded));
+        SubscribeToEvent(scene, E_COMPONENTREMOVED, URHO3D_HANDLER(NavMeshUpdater, HandleComponentRemoved));
+    }
+
+    virtual void PostUpdate(float dT){
+        time_ += dT;
+        if(!navmesh_)
+            return;
+
+        /// Nodes which have settled since they last moved: dirty the tiles they left, and the tiles they're in now
+        for(HashMap<Node*, float>::Iterator i = movedNodes_.Begin(); i!=movedNodes_.End();){
+            if(time_ - i->second_ < settleTime_){
+                ++i;
+                continue;
+            }
+            HashMap<Node*, TrackedNode>::Iterator t = tracked_.Find(i->first_);
+            if(t!=tracked_.End() && t->second_.node_){
+                MarkDirty(t->second_.box_);
+                t->second_.box_ = GetNavigationBox(t->second_.node_);
+                MarkDirty(t->second_.box_);
+            }
+            i = movedNodes_.Erase(i);
+        }
+
+        /// Start rebuilding some dirty tiles (their geometry is gathered here, the build happens on worker threads)
+        if(!dirtyTiles_.Empty()){
+            Vector<NavigationGeometryInfo> geometryList;
+            DynamicNavigationMeshAccess::CallCollectGeometries(navmesh_, geometryList);
+
+            int started = 0;
+            for(HashSet<unsigned>::Iterator i = dirtyTiles_.Begin(); i!=dirtyTiles_.End() && started<maxTilesPerFrame_;){
+                IntVector2 tile((int)(*i >> 16), (int)(*i & 0xffff));
+                builder_->StartTile(navmesh_, geometryList, tile);
+                i = dirtyTiles_.Erase(i);
+                started++;
+            }
+        }
+
+        /// Swap in whatever has finished building, within our budget
+        builder_->Update(updateBudgetMs_);
+    }
+
+    /// Dirty all tiles overlapped by a world space box (ie an area changed by something we don't track)
+    void MarkDirty(const BoundingBox& worldBox){
+        if(!navmesh_ || !worldBox.Defined())
+            return;
+        IntVector2 first, last;
+        BoundingBox localBox = worldBox.Transformed(navmesh_->GetNode()->GetWorldTransform().Inverse());
+        if(!NavTileBuilder::GetTileRange(navmesh_, localBox, first, last))
+            return;
+        for(int z=first.y_; z<=last.y_; z++)
+            for(int x=first.x_; x<=last.x_; x++)
+                dirtyTiles_.Insert(((unsigned)x << 16) | (unsigned)z);
+    }
+
+    unsigned GetNumDirtyTiles() const { return dirtyTiles_.Size(); }
+    bool IsBusy() const { return !dirtyTiles_.Empty() || !movedNodes_.Empty() || (builder_ && builder_->IsBusy()); }
+
+protected:
+
+    /// A tracked node (or one of its parents) has moved
+    virtual void OnMarkedDirty(Node* node){
+        /// Listeners may be notified from worker threads (ie animation) - we only follow main thread edits
+        if(node==node_ || !Thread::IsMainThread())
+            return;
+        if(tracked_.Contains(node))
+            movedNodes_[node] = time_;
+    }
+
+private:
+
+    /// Is this node's geometry part of the navmesh?
+    bool IsNavigationGeometry(Node* node) const {
+        if(!node || node->IsTemporary() || node->HasComponent<CrowdAgent>() || !node->HasComponent<StaticModel>())
+            return false;
+        for(Node* n=node; n; n=n->GetParent()){
+            Navigable* navigable = n->GetComponent<Navigable>();
+            if(navigable && navigable->IsEnabledEffective())
+                return n==node || navigable->IsRecursive();
+        }
+        return false;
+    }
+
+    BoundingBox GetNavigationBox(Node* node) const {
+        BoundingBox box;
+        PODVector<StaticModel*> models;
+        node->GetComponents<StaticModel>(models);
+        for(unsigned i=0; i<models.Size(); i++)
+            box.Merge(models[i]->GetWorldBoundingBox());
+        return box;
+    }
+
+    void Track(Node* node, bool dirty){
+        if(tracked_.Contains(node) || !IsNavigationGeometry(node))
+            return;
+        TrackedNode& tracked = tracked_[node];
+        tracked.node_ = node;
+        tracked.box_  = GetNavigationBox(node);
+        node->AddListener(this);
+        if(dirty)
+            MarkDirty(tracked.box_);
+    }
+
+    void Untrack(Node* node){
+        HashMap<Node*, TrackedNode>::Iterator i = tracked_.Find(node);
+        if(i==tracked_.End())
+            return;
+        MarkDirty(i->second_.box_);
+        node->RemoveListener(this);
+        tracked_.Erase(i);
+        movedNodes_.Erase(node);
+    }
+
+    void TrackSubtree(Node* root, bool dirty){
+        PODVector<StaticModel*> models;
+        root->GetComponents<StaticModel>(models, true);
+        for(unsigned i=0; i<models.Size(); i++)
+            Track(models[i]->GetNode(), dirty);
+    }
+
+    void HandleNodeAdded(StringHash eventType, VariantMap& eventData){
+        using namespace NodeAdded;
+        TrackSubtree(static_cast<Node*>(eventData[P_NODE].GetPtr()), true);
+    }
+
+    void HandleNodeRemoved(StringHash eventType, VariantMap& eventData){
+        using namespace NodeRemoved;
+        Node* node = static_cast<Node*>(eventData[P_NODE].GetPtr());
+        PODVector<StaticModel*> models;
+        node->GetComponents<StaticModel>(models, true);
+        for(unsigned i=0; i<models.Size(); i++)
+            Untrack(models[i]->GetNode());
+    }
+
+    void HandleComponentAdded(StringHash eventType, VariantMap& eventData){
+        using namespace ComponentAdded;
+        Component* comp = static_cast<Component*>(eventData[P_COMPONENT].GetPtr());
+        if(!comp)
+            return;
+        if(comp->GetType()==DynamicNavigationMesh::GetTypeStatic())
+            navmesh_ = static_cast<DynamicNavigationMesh*>(comp);
+        else if(comp->GetType()==StaticModel::GetTypeStatic())
+            Track(comp->GetNode(), true);
+        else if(comp->GetType()==CrowdAgent::GetTypeStatic())
+            Untrack(comp->GetNode());
+    }
+
+    void HandleComponentRemoved(StringHash eventType, VariantMap& eventData){
+        using namespace ComponentRemoved;
+        Component* comp = static_cast<Component*>(eventData[P_COMPONENT].GetPtr());
+        if(comp && comp->GetType()==StaticModel::GetTypeStatic())
+            Untrack(comp->GetNode());
+    }
+
+    WeakPtr<DynamicNavigationMesh>  navmesh_;
+    SharedPtr<NavTileBuilder>       builder_;
+
+    float   updateBudgetMs_=2.0f;   /// Main thread time per frame spent swapping in rebuilt tiles
+    float   settleTime_=0.25f;      /// How long a moved node must be still before its tiles are rebuilt
+    int     maxTilesPerFrame_=4;    /// Tile builds started per frame
+    float   time_=0.0f;
+
+    HashMap<Node*, TrackedNode> tracked_;
+    HashMap<Node*, float>       movedNodes_;    /// Tracked nodes which have moved, and when they last moved
+    HashSet<unsigned>           dirtyTiles_;    /// Tiles to rebuild, packed as (x << 16) | z
+};
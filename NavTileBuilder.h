@@ -0,0 +1,395 @@
+#pragma once
+
+#include <Urho3D/Navigation/NavBuildData.h>
+#include <Urho3D/ThirdParty/Recast/Recast.h>
+#include <Urho3D/ThirdParty/Detour/DetourNavMesh.h>
+#include <Urho3D/ThirdParty/DetourTileCache/DetourTileCache.h>
+#include <Urho3D/ThirdParty/DetourTileCache/DetourTileCacheBuilder.h>
+
+using namespace Urho3D;
+
+/// Access to the DynamicNavigationMesh internals we need to build tiles ourselves
+/// (a pointer-to-member formed through a derived class may be applied to any DynamicNavigationMesh)
+struct DynamicNavigationMeshAccess:public DynamicNavigationMesh
+{
+    typedef void (NavigationMesh::*CollectGeometriesFn)(Vector<NavigationGeometryInfo>&);
+
+    static void CallCollectGeometries(DynamicNavigationMesh* navmesh, Vector<NavigationGeometryInfo>& geometryList){
+        (navmesh->*static_cast<CollectGeometriesFn>(&DynamicNavigationMeshAccess::CollectGeometries))(geometryList);
+    }
+    static void CallGetTileGeometry(DynamicNavigationMesh* navmesh, NavBuildData* build, Vector<NavigationGeometryInfo>& geometryList, BoundingBox& box){
+        (navmesh->*(&DynamicNavigationMeshAccess::GetTileGeometry))(build, geometryList, box);
+    }
+    static dtTileCache* GetTileCache(DynamicNavigationMesh* navmesh) { return navmesh->*(&DynamicNavigationMeshAccess::tileCache_); }
+    static dtNavMesh*   GetNavMesh(DynamicNavigationMesh* navmesh)   { return navmesh->*(&DynamicNavigationMeshAccess::navMesh_); }
+};
+
+/// Tile cache layer compression, as DynamicNavigationMesh does it (LZ4).
+/// Our own stateless instance, so a build in flight never reaches into a navmesh which may have been destroyed.
+/// Only used to build layers - the tile cache decompresses them with its own compressor
+struct NavTileCompressor:public dtTileCacheCompressor
+{
+    virtual int maxCompressedSize(const int bufferSize){
+        return (int)EstimateCompressBound((unsigned)bufferSize);
+    }
+    virtual dtStatus compress(const unsigned char* buffer, const int bufferSize, unsigned char* compressed, const int maxCompressedSize, int* compressedSize){
+        *compressedSize = (int)CompressData(compressed, buffer, (unsigned)bufferSize);
+        return *compressedSize > 0 ? DT_SUCCESS : DT_FAILURE;
+    }
+    virtual dtStatus decompress(const unsigned char* compressed, const int compressedSize, unsigned char* buffer, const int maxBufferSize, int* bufferSize){
+        return DT_FAILURE;
+    }
+};
+
+/// Builds DynamicNavigationMesh tiles off the main thread.
+/// A tile build has three stages:
+/// - gather (main thread): the scene geometry overlapping the tile is collected, as DynamicNavigationMesh does
+/// - build (WorkQueue worker thread): Recast rasterizes the geometry, filters and erodes it, marks nav areas,
+///   and splits it into compressed tile cache layers - this is the expensive part, and it only touches the tile's own data
+/// - integrate (main thread): the tile's old layers and navmesh tiles are removed, the new layers are added, and
+///   the tile cache builds the navmesh tiles (applying obstacles). Each tile is swapped in by a single call,
+///   so agents and queries never see a half-built tile.
+/// Integration is time-sliced: Update() integrates finished tiles until its budget is used up.
+/// BuildAll() rebuilds a whole navmesh this way, blocking until it is done.
+/// Sends E_NAVIGATION_TILE_ADDED for every tile it replaces (as DynamicNavigationMesh does).
+class NavTileBuilder:public Object
+{
+    URHO3D_OBJECT(NavTileBuilder, Object);
+
+    /// One tile: input geometry, Recast config, and (once built) the compressed layers
+    struct TileJob:public RefCounted{
+        ~TileJob(){
+            for(unsigned i=0; i<layers_.Size(); i++)
+                dtFree(layers_[i].data_);
+        }
+
+        struct Layer{
+            unsigned char*  data_;
+            int             size_;
+        };
+
+        IntVector2              tile_;
+        rcConfig                config_;
+        NavBuildData            build_;
+        int                     maxLayers_=0;
+        PODVector<Layer>        layers_;
+        SharedPtr<WorkItem>     workItem_;
+    };
+
+public:
+    NavTileBuilder(Context* context):Object(context) { }
+
+    /// Workers may still be building our tiles: unstarted ones are taken off the queue, the rest are waited for
+    virtual ~NavTileBuilder(){
+        Cancel();
+        for(unsigned i=0; i<abandoned_.Size(); i++)
+            while(!abandoned_[i]->workItem_->completed_)
+                Time::Sleep(0);
+    }
+
+    /// Start building a tile of a DynamicNavigationMesh (geometry is gathered now, the build runs on a worker thread).
+    /// The geometry list comes from CollectGeometries - share one list between all the tiles started in a frame
+    bool StartTile(DynamicNavigationMesh* navmesh, Vector<NavigationGeometryInfo>& geometryList, const IntVector2& tile){
+        dtTileCache* tileCache = DynamicNavigationMeshAccess::GetTileCache(navmesh);
+        if(!tileCache)
+            return false;
+        if(navmesh_ && navmesh_!=navmesh)
+            Cancel();
+        navmesh_ = navmesh;
+
+        SharedPtr<TileJob> job(new TileJob());
+        job->tile_       = tile;
+        job->maxLayers_  = navmesh->GetMaxLayers();
+        SetupConfig(navmesh, tile, job->config_);
+
+        /// Gather the tile's geometry (with a border, so the tiles join up)
+        BoundingBox expandedBox(*reinterpret_cast<Vector3*>(job->config_.bmin), *reinterpret_cast<Vector3*>(job->config_.bmax));
+        DynamicNavigationMeshAccess::CallGetTileGeometry(navmesh, &job->build_, geometryList, expandedBox);
+
+        /// Build it on a worker thread (not a pooled work item - the queue would recycle it before we see it complete)
+        WorkQueue* queue = GetSubsystem<WorkQueue>();
+        job->workItem_ = new WorkItem();
+        job->workItem_->workFunction_ = BuildTileLayers;
+        job->workItem_->aux_ = job.Get();
+        job->workItem_->priority_ = 0;
+        queue->AddWorkItem(job->workItem_);
+
+        jobs_.Push(job);
+        return true;
+    }
+
+    /// Integrate finished tiles, in the order they were started, until the budget is spent (at least one tile).
+    /// Returns the number of tiles integrated
+    unsigned Update(float budgetMs){
+        for(unsigned i=0; i<abandoned_.Size();){
+            if(abandoned_[i]->workItem_->completed_)
+                abandoned_.EraseSwap(i);
+            else
+                i++;
+        }
+        if(!navmesh_){
+            Cancel();
+            return 0;
+        }
+        HiresTimer timer;
+        long long budget = (long long)(Min(budgetMs, 3600000.0f) * 1000.0f);
+        unsigned integrated = 0;
+
+        while(!jobs_.Empty() && jobs_.Front()->workItem_->completed_){
+            if(integrated && timer.GetUSec(false) >= budget)
+                break;
+            Integrate(jobs_.Front());
+            jobs_.PopFront();
+            integrated++;
+        }
+        return integrated;
+    }
+
+    /// Wait for every started tile to be built, and integrate them all
+    void Complete(){
+        if(jobs_.Empty())
+            return;
+        GetSubsystem<WorkQueue>()->Complete(0);
+        Update(3600000.0f);
+    }
+
+    /// Abandon tiles in progress: those not started yet are taken off the WorkQueue,
+    /// those being built are left to finish, then dropped
+    void Cancel(){
+        WorkQueue* queue = GetSubsystem<WorkQueue>();
+        for(List<SharedPtr<TileJob> >::Iterator i = jobs_.Begin(); i!=jobs_.End(); ++i){
+            if((*i)->workItem_->completed_ || (queue && queue->RemoveWorkItem((*i)->workItem_)))
+                continue;
+            abandoned_.Push(*i);
+        }
+        jobs_.Clear();
+        navmesh_.Reset();
+    }
+
+    /// Build a whole DynamicNavigationMesh, in parallel - what DynamicNavigationMesh::Build() does, tile by tile on the main thread.
+    /// The navmesh is sized to the current geometry and emptied, then the tiles are built on the WorkQueue threads
+    /// (the main thread helps, while it waits) and integrated as they complete. Blocks until the navmesh is done.
+    /// maxConcurrent limits how many tiles are built at once (0 = no limit, the WorkQueue spreads them over all its threads):
+    /// the tiles are then built in batches of that size
+    bool BuildAll(DynamicNavigationMesh* navmesh, unsigned maxConcurrent=0){
+        if(!navmesh || !navmesh->GetNode())
+            return false;
+        Cancel();
+
+        /// Size the navmesh to its geometry, plus padding (as Build() does)
+        Vector<NavigationGeometryInfo> geometryList;
+        DynamicNavigationMeshAccess::CallCollectGeometries(navmesh, geometryList);
+        BoundingBox box;
+        for(unsigned i=0; i<geometryList.Size(); i++)
+            box.Merge(geometryList[i].boundingBox_);
+        if(!box.Defined()){
+            URHO3D_LOGERROR("NavTileBuilder: no geometry to build the navigation mesh from");
+            return false;
+        }
+        box.min_ -= navmesh->GetPadding();
+        box.max_ += navmesh->GetPadding();
+
+        float tileEdge = navmesh->GetTileSize() * navmesh->GetCellSize();
+        Vector3 size = box.Size();
+        int tilesX = Max(CeilToInt(size.x_ / tileEdge), 1);
+        int tilesZ = Max(CeilToInt(size.z_ / tileEdge), 1);
+        /// Room for every layer of every tile, as Build() reserves - a tile's layers (ie box tops) are navmesh tiles of their own.
+        /// Allocate() takes a world space box (the geometry boxes are in navmesh space)
+        unsigned maxTiles = NextPowerOfTwo((unsigned)(tilesX * tilesZ)) * (unsigned)navmesh->GetMaxLayers();
+        if(!navmesh->Allocate(box.Transformed(navmesh->GetNode()->GetWorldTransform()), maxTiles))
+            return false;
+
+        IntVector2 numTiles = navmesh->GetNumTiles();
+        unsigned total = (unsigned)(numTiles.x_ * numTiles.y_);
+        unsigned batch = maxConcurrent ? maxConcurrent : total;
+        for(unsigned next=0; next<total;){
+            for(unsigned i=0; i<batch && next<total; i++, next++)
+                StartTile(navmesh, geometryList, IntVector2((int)next % numTiles.x_, (int)next / numTiles.x_));
+            Complete();
+        }
+
+        using namespace NavigationMeshRebuilt;
+        VariantMap& eventData = GetEventDataMap();
+        eventData[P_NODE] = navmesh->GetNode();
+        eventData[P_MESH] = navmesh;
+        navmesh->SendEvent(E_NAVIGATION_MESH_REBUILT, eventData);
+        return true;
+    }
+
+    unsigned GetNumPending() const { return jobs_.Size(); }
+    bool IsBusy() const { return !jobs_.Empty(); }
+
+    /// Local space bounding box of a tile
+    static BoundingBox GetTileBoundingBox(NavigationMesh* navmesh, const IntVector2& tile){
+        const BoundingBox& bounds = navmesh->GetBoundingBox();
+        float tileEdge = navmesh->GetTileSize() * navmesh->GetCellSize();
+        return BoundingBox(Vector3(bounds.min_.x_ + tileEdge * tile.x_,       bounds.min_.y_, bounds.min_.z_ + tileEdge * tile.y_),
+                           Vector3(bounds.min_.x_ + tileEdge * (tile.x_ + 1), bounds.max_.y_, bounds.min_.z_ + tileEdge * (tile.y_ + 1)));
+    }
+
+    /// Range of tiles overlapped by a local space box (false if it misses the navmesh)
+    static bool GetTileRange(NavigationMesh* navmesh, const BoundingBox& localBox, IntVector2& first, IntVector2& last){
+        const BoundingBox& bounds = navmesh->GetBoundingBox();
+        IntVector2 numTiles = navmesh->GetNumTiles();
+        float tileEdge = navmesh->GetTileSize() * navmesh->GetCellSize();
+        if(!numTiles.x_ || !numTiles.y_ || tileEdge<=0.0f)
+            return false;
+        first = IntVector2(FloorToInt((localBox.min_.x_ - bounds.min_.x_) / tileEdge), FloorToInt((localBox.min_.z_ - bounds.min_.z_) / tileEdge));
+        last  = IntVector2(FloorToInt((localBox.max_.x_ - bounds.min_.x_) / tileEdge), FloorToInt((localBox.max_.z_ - bounds.min_.z_) / tileEdge));
+        if(last.x_ < 0 || last.y_ < 0 || first.x_ >= numTiles.x_ || first.y_ >= numTiles.y_)
+            return false;
+        first = IntVector2(Max(first.x_, 0), Max(first.y_, 0));
+        last  = IntVector2(Min(last.x_, numTiles.x_-1), Min(last.y_, numTiles.y_-1));
+        return true;
+    }
+
+private:
+
+    /// Recast config for a tile - the same settings DynamicNavigationMesh uses
+    static void SetupConfig(DynamicNavigationMesh* navmesh, const IntVector2& tile, rcConfig& cfg){
+        memset(&cfg, 0, sizeof(rcConfig));
+        cfg.cs = navmesh->GetCellSize();
+        cfg.ch = navmesh->GetCellHeight();
+        cfg.walkableSlopeAngle = navmesh->GetAgentMaxSlope();
+        cfg.walkableHeight = (int)ceilf(navmesh->GetAgentHeight() / cfg.ch);
+        cfg.walkableClimb = (int)floorf(navmesh->GetAgentMaxClimb() / cfg.ch);
+        cfg.walkableRadius = (int)ceilf(navmesh->GetAgentRadius() / cfg.cs);
+        cfg.maxEdgeLen = (int)(navmesh->GetEdgeMaxLength() / cfg.cs);
+        cfg.maxSimplificationError = navmesh->GetEdgeMaxError();
+        cfg.minRegionArea = (int)sqrtf(navmesh->GetRegionMinSize());
+        cfg.mergeRegionArea = (int)sqrtf(navmesh->GetRegionMergeSize());
+        cfg.maxVertsPerPoly = 6;
+        cfg.tileSize = navmesh->GetTileSize();
+        cfg.borderSize = cfg.walkableRadius + 3;
+        cfg.width = cfg.tileSize + cfg.borderSize * 2;
+        cfg.height = cfg.tileSize + cfg.borderSize * 2;
+        cfg.detailSampleDist = navmesh->GetDetailSampleDistance() < 0.9f ? 0.0f : cfg.cs * navmesh->GetDetailSampleDistance();
+        cfg.detailSampleMaxError = cfg.ch * navmesh->GetDetailSampleMaxError();
+
+        BoundingBox tileBox = GetTileBoundingBox(navmesh, tile);
+        rcVcopy(cfg.bmin, &tileBox.min_.x_);
+        rcVcopy(cfg.bmax, &tileBox.max_.x_);
+        cfg.bmin[0] -= cfg.borderSize * cfg.cs;
+        cfg.bmin[2] -= cfg.borderSize * cfg.cs;
+        cfg.bmax[0] += cfg.borderSize * cfg.cs;
+        cfg.bmax[2] += cfg.borderSize * cfg.cs;
+    }
+
+    /// Shared by the workers (compression keeps no state)
+    static NavTileCompressor& GetCompressor(){
+        static NavTileCompressor compressor;
+        return compressor;
+    }
+
+    /// Worker thread: Recast the tile's geometry into compressed tile cache layers.
+    /// Touches nothing but the job's own data (and the stateless tile compressor)
+    static void BuildTileLayers(const WorkItem* item, unsigned threadIndex){
+        TileJob* job = static_cast<TileJob*>(item->aux_);
+        NavBuildData& build = job->build_;
+        rcConfig& cfg = job->config_;
+        if(build.vertices_.Empty() || build.indices_.Empty())
+            return;
+
+        build.heightField_ = rcAllocHeightfield();
+        if(!build.heightField_ || !rcCreateHeightfield(build.ctx_, *build.heightField_, cfg.width, cfg.height, cfg.bmin, cfg.bmax, cfg.cs, cfg.ch))
+            return;
+
+        unsigned numTriangles = build.indices_.Size() / 3;
+        PODVector<unsigned char> triAreas(numTriangles);
+        memset(&triAreas[0], 0, numTriangles);
+        rcMarkWalkableTriangles(build.ctx_, cfg.walkableSlopeAngle, &build.vertices_[0].x_, build.vertices_.Size(),
+                                &build.indices_[0], numTriangles, &triAreas[0]);
+        rcRasterizeTriangles(build.ctx_, &build.vertices_[0].x_, build.vertices_.Size(), &build.indices_[0],
+                             &triAreas[0], numTriangles, *build.heightField_, cfg.walkableClimb);
+        rcFilterLowHangingWalkableObstacles(build.ctx_, cfg.walkableClimb, *build.heightField_);
+        rcFilterWalkableLowHeightSpans(build.ctx_, cfg.walkableHeight, *build.heightField_);
+        rcFilterLedgeSpans(build.ctx_, cfg.walkableHeight, cfg.walkableClimb, *build.heightField_);
+
+        build.compactHeightField_ = rcAllocCompactHeightfield();
+        if(!build.compactHeightField_ ||
+           !rcBuildCompactHeightfield(build.ctx_, cfg.walkableHeight, cfg.walkableClimb, *build.heightField_, *build.compactHeightField_) ||
+           !rcErodeWalkableArea(build.ctx_, cfg.walkableRadius, *build.compactHeightField_))
+            return;
+
+        for(unsigned i=0; i<build.navAreas_.Size(); i++)
+            rcMarkBoxArea(build.ctx_, &build.navAreas_[i].bounds_.min_.x_, &build.navAreas_[i].bounds_.max_.x_,
+                          build.navAreas_[i].areaID_, *build.compactHeightField_);
+
+        rcHeightfieldLayerSet* layerSet = rcAllocHeightfieldLayerSet();
+        if(layerSet && rcBuildHeightfieldLayers(build.ctx_, *build.compactHeightField_, cfg.borderSize, cfg.walkableHeight, *layerSet)){
+            int numLayers = Min(layerSet->nlayers, job->maxLayers_);
+            for(int i=0; i<numLayers; i++){
+                const rcHeightfieldLayer& layer = layerSet->layers[i];
+
+                dtTileCacheLayerHeader header;
+                header.magic   = DT_TILECACHE_MAGIC;
+                header.version = DT_TILECACHE_VERSION;
+                header.tx      = job->tile_.x_;
+                header.ty      = job->tile_.y_;
+                header.tlayer  = i;
+                rcVcopy(header.bmin, layer.bmin);
+                rcVcopy(header.bmax, layer.bmax);
+                header.width  = (unsigned char)layer.width;
+                header.height = (unsigned char)layer.height;
+                header.minx   = (unsigned char)layer.minx;
+                header.maxx   = (unsigned char)layer.maxx;
+                header.miny   = (unsigned char)layer.miny;
+                header.maxy   = (unsigned char)layer.maxy;
+                header.hmin   = (unsigned short)layer.hmin;
+                header.hmax   = (unsigned short)layer.hmax;
+
+                TileJob::Layer result;
+                if(dtStatusSucceed(dtBuildTileCacheLayer(&GetCompressor(), &header, layer.heights, layer.areas, layer.cons, &result.data_, &result.size_)))
+                    job->layers_.Push(result);
+            }
+        }
+        rcFreeHeightfieldLayerSet(layerSet);
+
+        /// The heightfields are no longer needed - free them here, on the worker
+        rcFreeCompactHeightfield(build.compactHeightField_);
+        build.compactHeightField_ = nullptr;
+        rcFreeHeightField(build.heightField_);
+        build.heightField_ = nullptr;
+    }
+
+    /// Main thread: swap a built tile into the navmesh
+    void Integrate(TileJob* job){
+        dtTileCache* tileCache = DynamicNavigationMeshAccess::GetTileCache(navmesh_);
+        dtNavMesh* navMesh = DynamicNavigationMeshAccess::GetNavMesh(navmesh_);
+        if(!tileCache || !navMesh)
+            return;
+        int x = job->tile_.x_;
+        int z = job->tile_.y_;
+
+        /// Remove the old layers and their navmesh tiles
+        static const int MAX_TILE_LAYERS = 255;
+        dtCompressedTileRef oldTiles[MAX_TILE_LAYERS];
+        int numOld = tileCache->getTilesAt(x, z, oldTiles, MAX_TILE_LAYERS);
+        for(int i=0; i<numOld; i++)
+            tileCache->removeTile(oldTiles[i], nullptr, nullptr);
+        for(int i=0; i<MAX_TILE_LAYERS; i++){
+            dtTileRef ref = navMesh->getTileRefAt(x, z, i);
+            if(ref)
+                navMesh->removeTile(ref, nullptr, nullptr);
+        }
+
+        /// Add the new layers (the tile cache takes ownership of their data), and build the navmesh tiles
+        for(unsigned i=0; i<job->layers_.Size(); i++){
+            if(dtStatusFailed(tileCache->addTile(job->layers_[i].data_, job->layers_[i].size_, DT_COMPRESSEDTILE_FREE_DATA, nullptr)))
+                dtFree(job->layers_[i].data_);
+        }
+        job->layers_.Clear();
+        tileCache->buildNavMeshTilesAt(x, z, navMesh);
+
+        using namespace NavigationTileAdded;
+        VariantMap& eventData = GetEventDataMap();
+        eventData[P_NODE] = navmesh_->GetNode();
+        eventData[P_MESH] = navmesh_.Get();
+        eventData[P_TILE] = job->tile_;
+        navmesh_->SendEvent(E_NAVIGATION_TILE_ADDED, eventData);
+    }
+
+    WeakPtr<DynamicNavigationMesh>  navmesh_;
+    List<SharedPtr<TileJob> >       jobs_;          /// Started tiles, oldest first
+    Vector<SharedPtr<TileJob> >     abandoned_;     /// Cancelled tiles still held by a worker
+};
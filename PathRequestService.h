@@ -0,0 +1,245 @@
+#pragma once
+
+#include <Urho3D/ThirdParty/Detour/DetourNavMeshQuery.h>
+#include <Urho3D/ThirdParty/DetourCrowd/DetourCrowd.h>
+
+#include "CrowdController.h"
+
+using namespace Urho3D;
+
+/// Access to the CrowdManager's detour crowd (see DynamicNavigationMeshAccess for the trick)
+struct CrowdManagerAccess:public CrowdManager
+{
+    static dtCrowd* GetDetourCrowd(CrowdManager* crowd) { return (crowd->*(&CrowdManagerAccess::GetCrowd))(); }
+};
+
+/// Move orders for crowd agents, with shared pathfinding.
+/// CrowdAgent::SetTargetPosition has the detour crowd plan a path for each agent on its own: a group of agents
+/// sent to the same place costs one full path search per agent, queued over several frames.
+/// Instead, move requests made during a frame are collected, and processed together before the crowd updates:
+/// - requests for identical or nearby targets (within the same "Coalesce Radius" grid cell) are merged into one target
+/// - each agent's corridor is taken from a path cache, keyed by (start poly, end poly, query filter)
+/// - on a miss, one path is searched, and the agents of the group which stand on that path take its tail
+/// - only complete paths are used: an agent we can't serve (ie its target is unreachable) is left to the crowd to plan, as before
+/// Cached paths are dropped whenever the navmesh changes (tiles rebuilt, obstacles added or removed).
+class PathRequestService:public LogicComponent
+{
+    URHO3D_OBJECT(PathRequestService, LogicComponent);
+
+    /// Cache entries before the cache is flushed
+    static const unsigned MAX_CACHED_PATHS = 512;
+    /// Longest corridor we hand to an agent (the crowd's corridors hold up to 256 polys)
+    static const int MAX_PATH_POLYS = 255;
+
+    struct PathKey{
+        PathKey(dtPolyRef start, dtPolyRef end, unsigned filter):start_(start), end_(end), filter_(filter) { }
+        bool operator ==(const PathKey& rhs) const { return start_==rhs.start_ && end_==rhs.end_ && filter_==rhs.filter_; }
+        unsigned ToHash() const { return ((unsigned)start_ * 31 + (unsigned)end_) * 31 + filter_; }
+
+        dtPolyRef   start_;
+        dtPolyRef   end_;
+        unsigned    filter_;
+    };
+
+    struct MoveRequest{
+        WeakPtr<CrowdAgent> agent_;
+        Vector3             target_;
+    };
+
+    /// Requests merged into one target
+    struct RequestGroup{
+        Vector3                 target_;
+        PODVector<CrowdAgent*>  agents_;
+    };
+
+public:
+    static void RegisterObject(Context* context){
+        context->RegisterFactory<PathRequestService>();
+        URHO3D_ATTRIBUTE("Coalesce Radius", float, coalesceRadius_, 1.0f, AM_DEFAULT);
+    }
+
+    PathRequestService(Context* context):LogicComponent(context) {
+        SetUpdateEventMask(USE_UPDATE);
+    }
+
+    virtual ~PathRequestService(){
+        dtFreeNavMeshQuery(query_);
+    }
+
+    virtual void DelayedStart(){
+        SubscribeToEvent(E_NAVIGATION_MESH_REBUILT,     URHO3D_HANDLER(PathRequestService, HandleNavigationChanged));
+        SubscribeToEvent(E_NAVIGATION_AREA_REBUILT,     URHO3D_HANDLER(PathRequestService, HandleNavigationChanged));
+        SubscribeToEvent(E_NAVIGATION_TILE_ADDED,       URHO3D_HANDLER(PathRequestService, HandleNavigationChanged));
+        SubscribeToEvent(E_NAVIGATION_TILE_REMOVED,     URHO3D_HANDLER(PathRequestService, HandleNavigationChanged));
+        SubscribeToEvent(E_NAVIGATION_OBSTACLE_ADDED,   URHO3D_HANDLER(PathRequestService, HandleNavigationChanged));
+        SubscribeToEvent(E_NAVIGATION_OBSTACLE_REMOVED, URHO3D_HANDLER(PathRequestService, HandleNavigationChanged));
+    }
+
+    /// Send an agent to a target (takes effect before the crowd's next update - a later request this frame replaces it)
+    void RequestMove(CrowdAgent* agent, const Vector3& target){
+        if(!agent)
+            return;
+        MoveRequest& request = requests_[agent];
+        request.agent_  = agent;
+        request.target_ = target;
+    }
+
+    void RequestMove(const PODVector<CrowdAgent*>& agents, const Vector3& target){
+        for(unsigned i=0; i<agents.Size(); i++)
+            RequestMove(agents[i], target);
+    }
+
+    /// Send every agent in the crowd (or those under a node) to a target - CrowdManager::SetCrowdTarget, with shared paths
+    void RequestCrowdMove(const Vector3& target, Node* node=nullptr){
+        auto* crowd = GetScene()->GetComponent<CrowdManager>();
+        if(crowd)
+            RequestMove(crowd->GetAgents(node, true), target);
+    }
+
+    void ClearCache() { cache_.Clear(); }
+    unsigned GetNumCachedPaths() const { return cache_.Size(); }
+    /// Agents given a cached (or shared) corridor, and path searches made, since the service started
+    unsigned GetNumHits() const { return hits_; }
+    unsigned GetNumSearches() const { return searches_; }
+
+    /// Runs before the scene subsystem update, so our corridors are in place when the crowd updates
+    virtual void Update(float dT){
+        if(requests_.Empty())
+            return;
+        auto* crowdManager = GetScene()->GetComponent<CrowdManager>();
+        dtCrowd* crowd = crowdManager ? CrowdManagerAccess::GetDetourCrowd(crowdManager) : nullptr;
+        if(!crowd || !InitQuery(crowd)){
+            requests_.Clear();
+            return;
+        }
+
+        /// Merge requests by target cell - the group goes to the first target requested in its cell
+        HashMap<unsigned long long, RequestGroup> groups;
+        for(HashMap<CrowdAgent*, MoveRequest>::Iterator i = requests_.Begin(); i!=requests_.End(); ++i){
+            CrowdAgent* agent = i->second_.agent_;
+            if(!agent)
+                continue;
+            RequestGroup& group = groups[GetGridCellKey(i->second_.target_, coalesceRadius_)];
+            if(group.agents_.Empty())
+                group.target_ = i->second_.target_;
+            group.agents_.Push(agent);
+        }
+        requests_.Clear();
+
+        for(HashMap<unsigned long long, RequestGroup>::Iterator g = groups.Begin(); g!=groups.End(); ++g){
+            RequestGroup& group = g->second_;
+            groupPaths_.Clear();
+            for(unsigned i=0; i<group.agents_.Size(); i++){
+                CrowdAgent* agent = group.agents_[i];
+                /// The crowd still plans the target's nearest point and poly - we supply the corridor to it
+                agent->SetTargetPosition(group.target_);
+                AssignPath(crowd, agent);
+            }
+        }
+    }
+
+private:
+
+    /// Our own query object, so path searches don't disturb the crowd's - redone when the navmesh is reallocated
+    bool InitQuery(dtCrowd* crowd){
+        const dtNavMesh* navMesh = crowd->getNavMeshQuery() ? crowd->getNavMeshQuery()->getAttachedNavMesh() : nullptr;
+        if(!navMesh)
+            return false;
+        if(query_ && queryNavMesh_==navMesh)
+            return true;
+        cache_.Clear();
+        if(!query_)
+            query_ = dtAllocNavMeshQuery();
+        queryNavMesh_ = nullptr;
+        if(!query_ || dtStatusFailed(query_->init(navMesh, 2048)))
+            return false;
+        queryNavMesh_ = navMesh;
+        return true;
+    }
+
+    /// Give an agent which has just been sent to a target its corridor, as the crowd would once its path is planned.
+    /// Returns false if we left the agent to the crowd
+    bool AssignPath(dtCrowd* crowd, CrowdAgent* agent){
+        int id = agent->GetAgentCrowdId();
+        dtCrowdAgent* ag = id>=0 ? crowd->getEditableAgent(id) : nullptr;
+        /// Only agents with a fresh move request (an agent already heading to this target has none)
+        if(!ag || !ag->active || ag->state!=DT_CROWDAGENT_STATE_WALKING || ag->targetState!=DT_CROWDAGENT_TARGET_REQUESTING)
+            return false;
+        dtPolyRef startRef = ag->corridor.getFirstPoly();
+        dtPolyRef endRef = ag->targetRef;
+        if(!startRef || !endRef)
+            return false;
+
+        PathKey key(startRef, endRef, ag->params.queryFilterType);
+        HashMap<PathKey, PODVector<dtPolyRef> >::ConstIterator cached = cache_.Find(key);
+        if(cached!=cache_.End()){
+            hits_++;
+            SetCorridor(ag, cached->second_);
+            return true;
+        }
+
+        /// Does this agent stand on a path found for its group? Take the tail
+        for(unsigned i=0; i<groupPaths_.Size(); i++){
+            const PODVector<dtPolyRef>& path = groupPaths_[i];
+            if(path.Back()!=endRef)
+                continue;
+            for(unsigned j=0; j<path.Size(); j++){
+                if(path[j]!=startRef)
+                    continue;
+                hits_++;
+                PODVector<dtPolyRef> tail(&path[j], path.Size() - j);
+                SetCorridor(ag, tail);
+                Cache(key, tail);
+                return true;
+            }
+        }
+
+        /// Search - partial paths (target unreachable, or too far) are left to the crowd, which knows how to handle them
+        searches_++;
+        dtPolyRef polys[MAX_PATH_POLYS];
+        int numPolys = 0;
+        dtStatus status = query_->findPath(startRef, endRef, ag->npos, ag->targetPos, crowd->getFilter(ag->params.queryFilterType),
+                                           polys, &numPolys, MAX_PATH_POLYS);
+        if(dtStatusFailed(status) || (status & DT_PARTIAL_RESULT) || !numPolys || polys[numPolys-1]!=endRef)
+            return false;
+
+        PODVector<dtPolyRef> path(polys, (unsigned)numPolys);
+        SetCorridor(ag, path);
+        Cache(key, path);
+        groupPaths_.Push(path);
+        return true;
+    }
+
+    /// What the crowd does when a planned path arrives
+    static void SetCorridor(dtCrowdAgent* ag, const PODVector<dtPolyRef>& path){
+        ag->corridor.setCorridor(ag->targetPos, &path[0], (int)path.Size());
+        ag->boundary.reset();
+        ag->partial = false;    /// We only hand out complete paths
+        ag->targetState = DT_CROWDAGENT_TARGET_VALID;
+        ag->targetReplan = false;
+        ag->targetReplanTime = 0.0f;
+    }
+
+    void Cache(const PathKey& key, const PODVector<dtPolyRef>& path){
+        if(cache_.Size() >= MAX_CACHED_PATHS)
+            cache_.Clear();
+        cache_[key] = path;
+    }
+
+    void HandleNavigationChanged(StringHash eventType, VariantMap& eventData){
+        cache_.Clear();
+        groupPaths_.Clear();
+    }
+
+    float   coalesceRadius_=1.0f;   /// Targets in the same cell of this size are merged
+
+    HashMap<CrowdAgent*, MoveRequest>               requests_;      /// This frame's move requests
+    HashMap<PathKey, PODVector<dtPolyRef> >         cache_;
+    Vector<PODVector<dtPolyRef> >                   groupPaths_;    /// Paths searched for the group being processed
+
+    dtNavMeshQuery*     query_=nullptr;
+    const dtNavMesh*    queryNavMesh_=nullptr;  /// The navmesh our query was set up for
+
+    unsigned    hits_=0;
+    unsigned    searches_=0;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+using namespace Urho3D;
+
+/// Prefab instancing without XML.
+/// Scene::InstantiateXML walks the XML DOM (and parses every attribute string) for each instance.
+/// Here each prefab file is parsed just once: it is loaded into a detached template node, which is
+/// then saved into a compact binary template (the node tree with its attribute blobs, as written by Node::Save).
+/// Every instance after that is a Scene::Instantiate from that binary template - the same path binary scenes load
+/// through, which also remaps node and component IDs (and ID references) for each copy.
+/// Templates are dropped whenever their prefab file is reloaded by the ResourceCache.
+/// Registered as a subsystem by MyApp, so the InGameEditor can use it too.
+class PrefabCache:public Object
+{
+    URHO3D_OBJECT(PrefabCache, Object);
+
+    struct PrefabTemplate{
+        SharedPtr<XMLFile>      file_;      /// Source file (held to receive its reload events)
+        PODVector<unsigned char> data_;     /// Binary template
+    };
+
+public:
+    PrefabCache(Context* context):Object(context) { }
+
+    /// Instantiate a prefab (xml file) into a scene, at the given transform - returns the new root node, or null on failure
+    Node* Instantiate(Scene* scene, const String& filepath, const Vector3& position=Vector3::ZERO, const Quaternion& rotation=Quaternion::IDENTITY, CreateMode mode=REPLICATED){
+        if(!scene)
+            return nullptr;
+        const PrefabTemplate* prefab = GetTemplate(filepath);
+        if(!prefab)
+            return nullptr;
+        MemoryBuffer buffer(prefab->data_);
+        return scene->Instantiate(buffer, position, rotation, mode);
+    }
+
+    /// Parse a prefab ahead of time (ie during level load), so its first instance is as cheap as the rest
+    bool Preload(const String& filepath) { return GetTemplate(filepath)!=nullptr; }
+
+    void Clear() { templates_.Clear(); }
+    unsigned GetNumTemplates() const { return templates_.Size(); }
+
+private:
+
+    const PrefabTemplate* GetTemplate(const String& filepath){
+        StringHash key(filepath);
+        HashMap<StringHash, PrefabTemplate>::ConstIterator i = templates_.Find(key);
+        if(i!=templates_.End())
+            return &i->second_;
+
+        SharedPtr<XMLFile> file(GetSubsystem<ResourceCache>()->GetResource<XMLFile>(filepath));
+        if(!file)
+            return nullptr;
+
+        /// Parse the xml once, into a node that never joins a scene, and keep its binary form
+        /// (keeping the root's saved ID, so references to it inside the prefab still resolve on each copy)
+        SharedPtr<Node> node(new Node(context_));
+        node->SetID(file->GetRoot().GetUInt("id"));
+        if(!node->LoadXML(file->GetRoot())){
+            URHO3D_LOGERROR("PrefabCache could not load prefab "+filepath);
+            return nullptr;
+        }
+        VectorBuffer buffer;
+        if(!node->Save(buffer)){
+            URHO3D_LOGERROR("PrefabCache could not build a template for "+filepath);
+            return nullptr;
+        }
+
+        PrefabTemplate& prefab = templates_[key];
+        prefab.file_ = file;
+        prefab.data_ = buffer.GetBuffer();
+        SubscribeToEvent(file, E_RELOADFINISHED, URHO3D_HANDLER(PrefabCache, HandlePrefabReloaded));
+        return &prefab;
+    }
+
+    /// A prefab file was changed on disk - rebuild its templates on next use
+    /// (templates are keyed by the path they were requested with, so one file may have several)
+    void HandlePrefabReloaded(StringHash eventType, VariantMap& eventData){
+        Object* sender = GetEventSender();
+        UnsubscribeFromEvent(sender, E_RELOADFINISHED);
+        for(HashMap<StringHash, PrefabTemplate>::Iterator i = templates_.Begin(); i!=templates_.End();){
+            if(i->second_.file_.Get()==sender)
+                i = templates_.Erase(i);
+            else
+                ++i;
+        }
+    }
+
+    HashMap<StringHash, PrefabTemplate> templates_;
+};
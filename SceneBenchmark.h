@@ -0,0 +1,197 @@
+#pragma once
+
+#include "EditorHistory.h"
+#include "EditorOverlay.h"
+#include "PathRequestService.h"
+
+using namespace Urho3D;
+
+/// Headless benchmark: runs a fixed, scripted scenario on a loaded scene for a number of frames,
+/// then prints frame time percentiles and asks the engine to exit.
+/// The scenario is driven by the frame number (not by time or input), so every run does the same work:
+/// - the camera orbits the scene, bobbing up and down
+/// - a crowd of agents is given a new shared target every few seconds
+/// - editor operations, as the InGameEditor performs them: a triangle pick every frame, a marquee
+///   (sub-frustum) selection, an undoable batch edit of the selection, and an undo / redo
+/// There is no window, so nothing is rendered - this measures the simulation and editor side of a frame.
+/// Started by MyApp when launched with "-benchmark <frames>".
+class SceneBenchmark:public Object
+{
+    URHO3D_OBJECT(SceneBenchmark, Object);
+
+    /// Frames run before we start measuring (first-frame resource loads, octree settling...)
+    static const unsigned WARMUP_FRAMES = 10;
+    /// Extra agents spawned for the crowd
+    static const unsigned NUM_AGENTS = 100;
+
+public:
+    SceneBenchmark(Context* context):Object(context) { }
+
+    void Start(Scene* scene, Node* cameraNode, unsigned frames){
+        scene_      = scene;
+        cameraNode_ = cameraNode;
+        frames_     = frames;
+        frame_      = 0;
+        frameTimes_.Clear();
+        frameTimes_.Reserve(frames);
+
+        history_ = new EditorHistory(context_);
+        SetRandomSeed(1);
+
+        /// No viewport: give the camera the aspect ratio of a typical window
+        cameraNode_->GetOrCreateComponent<Camera>()->SetAspectRatio(16.0f / 9.0f);
+
+        /// Populate the crowd
+        auto* navmesh = scene_->GetDerivedComponent<NavigationMesh>();
+        if(navmesh){
+            scene_->GetOrCreateComponent<CrowdManager>();
+            for(unsigned i=0; i<NUM_AGENTS; i++){
+                Node* node = scene_->CreateChild("Benchmark Agent", LOCAL);
+                node->SetTemporary(true);
+                node->SetPosition(navmesh->GetRandomPoint());
+                auto* agent = node->CreateComponent<CrowdAgent>(LOCAL);
+                agent->SetHeight(2.0f);
+                agent->SetMaxSpeed(3.0f);
+                agent->SetMaxAccel(5.0f);
+            }
+        }
+
+        SubscribeToEvent(E_BEGINFRAME, URHO3D_HANDLER(SceneBenchmark, HandleBeginFrame));
+        SubscribeToEvent(E_UPDATE,     URHO3D_HANDLER(SceneBenchmark, HandleUpdate));
+        timer_.Reset();
+        URHO3D_LOGINFO("Benchmark: running "+String(frames_)+" frames");
+    }
+
+private:
+
+    /// Frame timing - from the start of one frame to the start of the next
+    void HandleBeginFrame(StringHash eventType, VariantMap& eventData){
+        float ms = timer_.GetUSec(true) / 1000.0f;
+        if(frame_ > WARMUP_FRAMES)
+            frameTimes_.Push(ms);
+
+        if(frame_ >= frames_ + WARMUP_FRAMES){
+            Report();
+            UnsubscribeFromAllEvents();
+            GetSubsystem<Engine>()->Exit();
+        }
+        frame_++;
+    }
+
+    /// The scripted scenario
+    void HandleUpdate(StringHash eventType, VariantMap& eventData){
+        if(!scene_ || !cameraNode_)
+            return;
+
+        /// Orbit the camera around the middle of the scene
+        float angle = frame_ * 0.5f;
+        cameraNode_->SetPosition(Vector3(Cos(angle) * 40.0f, 15.0f + Sin(angle * 3.0f) * 5.0f, Sin(angle) * 40.0f));
+        cameraNode_->LookAt(Vector3::ZERO);
+        auto* camera = cameraNode_->GetComponent<Camera>();
+
+        /// Pick under a "cursor" that sweeps the screen
+        Ray ray = camera->GetScreenRay(0.5f + Sin(frame_ * 2.0f) * 0.4f, 0.5f + Cos(frame_ * 1.3f) * 0.4f);
+        PODVector<RayQueryResult> results;
+        RayOctreeQuery rayQuery(results, ray, RAY_TRIANGLE, 100.0f, DRAWABLE_GEOMETRY, EDITOR_QUERY_VIEWMASK);
+        scene_->GetComponent<Octree>()->RaycastSingle(rayQuery);
+
+        if(frame_ % 30 == 0)
+            MarqueeSelect(camera);
+        if(frame_ % 60 == 0)
+            BatchEdit();
+        if(frame_ % 120 == 60){
+            history_->Undo(scene_);
+            history_->Redo(scene_);
+        }
+
+        /// Send the whole crowd somewhere new (through the path request service, if the scene has one)
+        if(frame_ % 240 == 0){
+            auto* crowd = scene_->GetComponent<CrowdManager>();
+            auto* pathRequests = scene_->GetComponent<PathRequestService>();
+            auto* navmesh = scene_->GetDerivedComponent<NavigationMesh>();
+            if(pathRequests && navmesh)
+                pathRequests->RequestCrowdMove(navmesh->GetRandomPoint());
+            else if(crowd && navmesh)
+                crowd->SetCrowdTarget(navmesh->GetRandomPoint());
+        }
+    }
+
+    /// Select everything in the middle third of the screen
+    void MarqueeSelect(Camera* camera){
+        Frustum frustum;
+        Matrix4 crop(3.0f, 0.0f, 0.0f, 0.0f,
+                     0.0f, 3.0f, 0.0f, 0.0f,
+                     0.0f, 0.0f, 1.0f, 0.0f,
+                     0.0f, 0.0f, 0.0f, 1.0f);
+        frustum.Define(crop * camera->GetProjection() * camera->GetView());
+
+        PODVector<Drawable*> drawables;
+        FrustumOctreeQuery query(drawables, frustum, DRAWABLE_GEOMETRY, EDITOR_QUERY_VIEWMASK);
+        scene_->GetComponent<Octree>()->GetDrawables(query);
+
+        selection_.Clear();
+        for(unsigned i=0; i<drawables.Size(); i++){
+            Node* node = drawables[i]->GetNode();
+            if(node!=scene_ && !selection_.Contains(node))
+                selection_.Push(node);
+        }
+    }
+
+    /// Nudge the selection upwards and back again, as one undoable step
+    void BatchEdit(){
+        history_->BeginEdit();
+        float offset = (frame_ / 60) % 2 ? -0.01f : 0.01f;
+        for(unsigned i=0; i<selection_.Size(); i++){
+            Node* node = selection_[i];
+            unsigned index = GetAttributeIndex(node, "Position");
+            if(index==M_MAX_UNSIGNED)
+                continue;
+            Variant oldValue = node->GetAttribute(index);
+            Variant newValue = oldValue.GetVector3() + Vector3(0.0f, offset, 0.0f);
+            node->SetAttribute(index, newValue);
+            history_->AddAttributeDelta(node, index, oldValue, newValue);
+        }
+        history_->EndEdit();
+    }
+
+    static unsigned GetAttributeIndex(Serializable* object, const String& name){
+        const Vector<AttributeInfo>* attributes = object->GetAttributes();
+        if(attributes)
+            for(unsigned i=0; i<attributes->Size(); i++)
+                if((*attributes)[i].name_==name)
+                    return i;
+        return M_MAX_UNSIGNED;
+    }
+
+    void Report(){
+        unsigned count = frameTimes_.Size();
+        if(!count){
+            PrintLine("Benchmark: no frames measured");
+            return;
+        }
+        float total = 0.0f;
+        for(unsigned i=0; i<count; i++)
+            total += frameTimes_[i];
+        Sort(frameTimes_.Begin(), frameTimes_.End());
+
+        PrintLine("Benchmark: "+String(count)+" frames, mean "+String(total / count)+" ms");
+        PrintLine("  p50 "+String(Percentile(0.50f))+" ms, p90 "+String(Percentile(0.90f))+" ms, p95 "+String(Percentile(0.95f))+
+                  " ms, p99 "+String(Percentile(0.99f))+" ms, max "+String(frameTimes_.Back())+" ms");
+    }
+
+    /// Frame times must be sorted
+    float Percentile(float fraction) const {
+        unsigned index = (unsigned)(fraction * (frameTimes_.Size() - 1) + 0.5f);
+        return frameTimes_[Min(index, frameTimes_.Size() - 1)];
+    }
+
+    WeakPtr<Scene>              scene_;
+    WeakPtr<Node>               cameraNode_;
+    SharedPtr<EditorHistory>    history_;
+    PODVector<Node*>            selection_;     /// Rebuilt by each marquee selection
+
+    unsigned            frames_=0;
+    unsigned            frame_=0;
+    HiresTimer          timer_;
+    PODVector<float>    frameTimes_;            /// Milliseconds per measured frame
+};
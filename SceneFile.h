@@ -0,0 +1,250 @@
+#pragma once
+
+using namespace Urho3D;
+
+/// Scene file helpers, shared by MyApp and the InGameEditor.
+/// The scene format is selected by file extension:
+/// ".bin" files use Urho's binary scene format, anything else is treated as XML.
+/// Binary scenes load without any text parsing, which makes them ideal for hot-reloading.
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Compact encoding for bulky buffer attributes in xml scene files (NavigationMesh "Navigation Data",
+/// InstancedProps "Instances")
+/// Urho writes buffer attributes to xml as space-separated decimal bytes, which for these
+/// makes up the bulk of our scene files.
+/// When saving xml, we replace that with an LZ4-compressed, base64-encoded copy:
+///     <attribute name="Navigation Data" value="" encoding="lz4base64" data="..." />
+/// When loading, the packed data is stripped out before the scene is loaded,
+/// then decoded and handed straight to the component (no text-to-buffer parsing).
+
+/// Encoding tag for packed buffer attributes
+static const String PACKED_BUFFER_ENCODING = "lz4base64";
+
+/// Base64 encode raw bytes
+inline String EncodeBase64Buffer(const unsigned char* data, unsigned size){
+    static const char* table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    String result;
+    result.Reserve(((size + 2) / 3) * 4);
+    for(unsigned i=0; i<size; i+=3){
+        unsigned triple = (unsigned)data[i] << 16;
+        if(i+1<size) triple |= (unsigned)data[i+1] << 8;
+        if(i+2<size) triple |= (unsigned)data[i+2];
+        result += table[(triple >> 18) & 0x3f];
+        result += table[(triple >> 12) & 0x3f];
+        result += (i+1<size) ? table[(triple >> 6) & 0x3f] : '=';
+        result += (i+2<size) ? table[triple & 0x3f] : '=';
+    }
+    return result;
+}
+
+/// Base64 decode to raw bytes - returns false on malformed input
+inline bool DecodeBase64Buffer(const String& text, PODVector<unsigned char>& dest){
+    dest.Clear();
+    dest.Reserve(text.Length() / 4 * 3);
+    unsigned triple=0;
+    int bits=0;
+    for(unsigned i=0; i<text.Length(); i++){
+        char c = text[i];
+        int value;
+        if(c>='A' && c<='Z')        value = c-'A';
+        else if(c>='a' && c<='z')   value = c-'a'+26;
+        else if(c>='0' && c<='9')   value = c-'0'+52;
+        else if(c=='+')             value = 62;
+        else if(c=='/')             value = 63;
+        else if(c=='=')             break;
+        else return false;
+
+        triple = (triple << 6) | value;
+        bits += 6;
+        if(bits>=8){
+            bits -= 8;
+            dest.Push((unsigned char)((triple >> bits) & 0xff));
+        }
+    }
+    return true;
+}
+
+/// Compress and encode a buffer attribute value for storage in xml
+inline String PackBufferAttribute(const PODVector<unsigned char>& data){
+    VectorBuffer src(data);
+    VectorBuffer packed = CompressVectorBuffer(src);
+    return EncodeBase64Buffer(packed.GetData(), packed.GetSize());
+}
+
+/// Decode and decompress a buffer attribute value previously packed for xml
+inline bool UnpackBufferAttribute(const String& text, PODVector<unsigned char>& dest){
+    PODVector<unsigned char> packed;
+    if(!DecodeBase64Buffer(text, packed) || packed.Empty())
+        return false;
+    VectorBuffer src(packed);
+    VectorBuffer unpacked = DecompressVectorBuffer(src);
+    dest = unpacked.GetBuffer();
+    return !dest.Empty();
+}
+
+/// Bulky buffer attribute unpacked from an xml scene, waiting to be applied to its component
+struct PackedBufferData{
+    unsigned componentID_;
+    String   name_;
+    PODVector<unsigned char> data_;
+};
+
+/// Returns true if an xml "component" element's buffer attribute is stored packed:
+/// NavigationMesh "Navigation Data", and InstancedProps "Instances" (the packed instance transforms)
+inline bool IsPackedBufferAttribute(const XMLElement& comp, const String& name){
+    const String type = comp.GetAttribute("type");
+    if(type=="DynamicNavigationMesh" || type=="NavigationMesh")
+        return name=="Navigation Data";
+    return type=="InstancedProps" && name=="Instances";
+}
+
+/// Recursively pack the bulky buffer attributes of an xml scene (or node) element
+inline void PackBufferAttributes(XMLElement& element){
+    for(XMLElement comp = element.GetChild("component"); comp.NotNull(); comp = comp.GetNext("component")){
+        for(XMLElement attr = comp.GetChild("attribute"); attr.NotNull(); attr = attr.GetNext("attribute")){
+            if(!IsPackedBufferAttribute(comp, attr.GetAttribute("name")))
+                continue;
+            PODVector<unsigned char> data = attr.GetBuffer("value");
+            if(data.Empty())
+                continue;
+            attr.SetAttribute("value", "");
+            attr.SetAttribute("encoding", PACKED_BUFFER_ENCODING);
+            attr.SetAttribute("data", PackBufferAttribute(data));
+        }
+    }
+
+    for(XMLElement child = element.GetChild("node"); child.NotNull(); child = child.GetNext("node"))
+        PackBufferAttributes(child);
+}
+
+/// Recursively collect (and strip) packed buffer attributes from an xml scene (or node) element
+inline void UnpackBufferAttributes(XMLElement& element, Vector<PackedBufferData>& result){
+    for(XMLElement comp = element.GetChild("component"); comp.NotNull(); comp = comp.GetNext("component")){
+        for(XMLElement attr = comp.GetChild("attribute"); attr.NotNull(); attr = attr.GetNext("attribute")){
+            if(attr.GetAttribute("encoding")!=PACKED_BUFFER_ENCODING)
+                continue;
+            PackedBufferData packed;
+            packed.componentID_ = comp.GetUInt("id");
+            packed.name_ = attr.GetAttribute("name");
+            if(UnpackBufferAttribute(attr.GetAttribute("data"), packed.data_))
+                result.Push(packed);
+            else
+                URHO3D_LOGERROR("Failed to unpack "+packed.name_+" for component "+String(packed.componentID_));
+            attr.RemoveAttribute("data");
+            attr.RemoveAttribute("encoding");
+        }
+    }
+
+    for(XMLElement child = element.GetChild("node"); child.NotNull(); child = child.GetNext("node"))
+        UnpackBufferAttributes(child, result);
+}
+
+/// Hand unpacked buffer attributes to the (freshly loaded) components
+inline void ApplyBufferAttributes(Scene* scene, const Vector<PackedBufferData>& packed){
+    for(unsigned i=0; i<packed.Size(); i++){
+        Component* comp = scene->GetComponent(packed[i].componentID_);
+        if(!comp)
+            continue;
+        comp->SetAttribute(packed[i].name_, Variant(packed[i].data_));
+        comp->ApplyAttributes();
+        if(!comp->IsInstanceOf<NavigationMesh>())
+            continue;
+
+        /// The navmesh was empty while the rest of the scene loaded,
+        /// so let our CrowdManager know it needs to recreate the crowd
+        using namespace NavigationMeshRebuilt;
+        VariantMap& eventData = comp->GetEventDataMap();
+        eventData[P_NODE] = comp->GetNode();
+        eventData[P_MESH] = comp;
+        comp->SendEvent(E_NAVIGATION_MESH_REBUILT, eventData);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Returns true if the filepath names a binary scene file
+inline bool IsBinarySceneFile(const String& filepath){
+    return GetExtension(filepath) == ".bin";
+}
+
+/// Returns the same filepath, with its extension swapped for the "other" scene format
+/// ie "MyGameScene.xml" <-> "MyGameScene.bin"
+inline String GetSceneTwinPath(const String& filepath){
+    return ReplaceExtension(filepath, IsBinarySceneFile(filepath) ? ".xml" : ".bin");
+}
+
+/// Save a scene to file (full path), in the format implied by the file extension
+inline bool SaveSceneFile(Scene* scene, const String& fullpath){
+    bool success=false;
+    File file(scene->GetContext(), fullpath, FILE_WRITE);
+    if(file.IsOpen()){
+        if(IsBinarySceneFile(fullpath))
+            success = scene->Save(file);
+        else{
+            /// Save to an xml document first, so we can pack the navigation data before writing
+            SharedPtr<XMLFile> xml(new XMLFile(scene->GetContext()));
+            XMLElement root = xml->CreateRoot("scene");
+            if(static_cast<Node*>(scene)->SaveXML(root)){
+                PackBufferAttributes(root);
+                success = xml->Save(file);
+            }
+        }
+        file.Close();
+    }
+    return success;
+}
+
+/// Load a scene from file (full path), in the format implied by the file extension
+/// Note: the existing content of the scene is destroyed!
+inline bool LoadSceneFile(Scene* scene, const String& fullpath){
+    bool success=false;
+    File file(scene->GetContext(), fullpath, FILE_READ);
+    if(file.IsOpen()){
+        if(IsBinarySceneFile(fullpath))
+            success = scene->Load(file);
+        else{
+            /// Parse the xml document ourselves, so we can pull out packed navigation data
+            SharedPtr<XMLFile> xml(new XMLFile(scene->GetContext()));
+            if(xml->Load(file)){
+                XMLElement root = xml->GetRoot();
+                Vector<PackedBufferData> packedData;
+                UnpackBufferAttributes(root, packedData);
+                /// The XMLElement overload of LoadXML does not clear the scene first (old vars, file name and checksum survive)
+                scene->Clear();
+                success = scene->LoadXML(root);
+                if(success)
+                    ApplyBufferAttributes(scene, packedData);
+            }
+        }
+        file.Close();
+    }
+    return success;
+}
+
+/// XML <-> Binary scene converter
+/// The source file is loaded into a scratch scene (which is never updated, so components
+/// like our InGameEditor never start), then saved again in the destination format.
+inline bool ConvertSceneFile(Context* context, const String& srcPath, const String& dstPath){
+    SharedPtr<Scene> scratch(new Scene(context));
+    if(!LoadSceneFile(scratch, srcPath)){
+        URHO3D_LOGERROR("Scene conversion failed to load: "+srcPath);
+        return false;
+    }
+    if(!SaveSceneFile(scratch, dstPath)){
+        URHO3D_LOGERROR("Scene conversion failed to save: "+dstPath);
+        return false;
+    }
+    URHO3D_LOGINFO("Converted scene "+srcPath+" to "+dstPath);
+    return true;
+}
+
+/// Returns true if the binary twin of a scene file exists, and is at least as new as the file itself
+/// (so it's safe to load the binary file in place of the original)
+inline bool HasFreshBinaryTwin(FileSystem* fs, const String& fullpath){
+    if(IsBinarySceneFile(fullpath))
+        return false;
+    String twin = GetSceneTwinPath(fullpath);
+    if(!fs->FileExists(twin))
+        return false;
+    return fs->GetLastModifiedTime(twin) >= fs->GetLastModifiedTime(fullpath);
+}
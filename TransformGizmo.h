@@ -0,0 +1,470 @@
+#pragma once
+
+#include "EditorHistory.h"
+#include "EditorOverlay.h"
+
+using namespace Urho3D;
+
+/// Translate / Rotate / Scale gizmo for the InGameEditor.
+/// The gizmo sits on the primary selected node and is drawn into the editor overlay, at a constant size on screen.
+/// Hit testing is done on the CPU against the handles' ideal shapes (axis segments, plane squares, rings, center sphere),
+/// using the editor's pick ray - no geometry or octree queries involved.
+/// Dragging moves every node in the selection set: their start transforms are captured once, when the drag begins,
+/// into scratch storage allocated up front, so no memory is allocated while dragging.
+/// When the drag ends, the changes are recorded as one undo step.
+class TransformGizmo:public Object
+{
+    URHO3D_OBJECT(TransformGizmo, Object);
+public:
+
+    enum GizmoMode{
+        GIZMO_TRANSLATE,
+        GIZMO_ROTATE,
+        GIZMO_SCALE
+    };
+
+    enum GizmoHandle{
+        HANDLE_NONE=-1,
+        HANDLE_X, HANDLE_Y, HANDLE_Z,       /// Axis (translate, scale), or ring (rotate)
+        HANDLE_YZ, HANDLE_ZX, HANDLE_XY,    /// Plane (translate) - named by the axes it spans, indexed by its normal
+        HANDLE_CENTER                       /// Uniform scale
+    };
+
+    /// Drag scratch storage reserved up front (grown at drag start if a larger selection is dragged)
+    static const unsigned MAX_DRAG_NODES = 4096;
+
+    TransformGizmo(Context* context):Object(context) {
+        /// Scratch storage for the drag - allocated once
+        dragItems_.Resize(MAX_DRAG_NODES);
+    }
+
+    void SetMode(GizmoMode mode) { if(!dragging_) mode_ = mode; }
+    GizmoMode GetMode() const { return mode_; }
+    void CycleMode() { SetMode((GizmoMode)((mode_+1) % 3)); }
+    String GetModeName() const { return mode_==GIZMO_TRANSLATE ? "Translate" : mode_==GIZMO_ROTATE ? "Rotate" : "Scale"; }
+
+    /// Align the gizmo axes with the target node (local space) or the world axes
+    void SetLocalSpace(bool enable) { localSpace_ = enable; }
+
+    /// Screen size of the gizmo, as a fraction of the distance to the camera
+    void SetScreenSize(float size) { screenSize_ = size; }
+
+    bool IsVisible() const { return visible_; }
+    bool IsDragging() const { return dragging_; }
+    bool IsHovering() const { return hover_!=HANDLE_NONE; }
+
+    /// Place the gizmo on the target node, sized for the camera - call once per frame
+    void Place(Node* target, Camera* camera){
+        visible_ = target && camera && !target->IsInstanceOf<Scene>();
+        if(!visible_){
+            hover_ = HANDLE_NONE;
+            return;
+        }
+
+        origin_ = target->GetWorldPosition();
+        Quaternion rotation = localSpace_ ? target->GetWorldRotation() : Quaternion::IDENTITY;
+        axes_[0] = rotation * Vector3::RIGHT;
+        axes_[1] = rotation * Vector3::UP;
+        axes_[2] = rotation * Vector3::FORWARD;
+
+        Node* cameraNode = camera->GetNode();
+        if(camera->IsOrthographic())
+            size_ = camera->GetOrthoSize() * screenSize_;
+        else
+            size_ = Max((origin_ - cameraNode->GetWorldPosition()).Length(), camera->GetNearClip()) * screenSize_;
+        viewDirection_ = cameraNode->GetWorldDirection();
+    }
+
+    /// Find the handle under the ray (the nearest, if several), and remember it as the hovered handle
+    GizmoHandle UpdateHover(const Ray& ray){
+        if(dragging_)
+            return hover_;
+        hover_ = visible_ ? HitTest(ray) : HANDLE_NONE;
+        return hover_;
+    }
+
+    /// Begin dragging the hovered handle - moves the given nodes (ie the editor's selection set)
+    bool BeginDrag(const Ray& ray, const Vector<WeakPtr<Node>>& nodes){
+        if(!visible_ || hover_==HANDLE_NONE || dragging_)
+            return false;
+
+        dragHandle_ = hover_;
+        dragOrigin_ = origin_;
+        for(unsigned i=0; i<3; i++)
+            dragAxes_[i] = axes_[i];
+        if(!GetDragParameter(ray, dragStart_))
+            return false;
+
+        /// Capture the start transforms. Nodes whose ancestor is also being dragged are skipped -
+        /// they'll follow their parent anyway
+        if(dragItems_.Size() < nodes.Size())
+            dragItems_.Resize(nodes.Size());
+        dragSet_.Clear();
+        for(unsigned i=0; i<nodes.Size(); i++)
+            if(nodes[i])
+                dragSet_.Insert(nodes[i].Get());
+        dragCount_ = 0;
+        for(unsigned i=0; i<nodes.Size(); i++){
+            Node* node = nodes[i];
+            if(!node || node->IsInstanceOf<Scene>() || HasDraggedAncestor(node))
+                continue;
+            DragItem& item = dragItems_[dragCount_++];
+            item.node_          = node;
+            item.worldPosition_ = node->GetWorldPosition();
+            item.worldRotation_ = node->GetWorldRotation();
+            item.position_      = node->GetPosition();
+            item.rotation_      = node->GetRotation();
+            item.scale_         = node->GetScale();
+        }
+
+        dragging_ = dragCount_>0;
+        return dragging_;
+    }
+
+    /// Move the dragged nodes to follow the ray
+    void Drag(const Ray& ray){
+        if(!dragging_)
+            return;
+
+        Vector3 current;
+        if(!GetDragParameter(ray, current))
+            return;
+
+        switch(mode_){
+            case GIZMO_TRANSLATE:{
+                Vector3 delta = current - dragStart_;
+                for(unsigned i=0; i<dragCount_; i++){
+                    DragItem& item = dragItems_[i];
+                    if(item.node_)
+                        item.node_->SetWorldPosition(item.worldPosition_ + delta);
+                }
+                break;
+            }
+            case GIZMO_ROTATE:{
+                /// Signed angle between the start and current directions, around the ring's axis
+                const Vector3& axis = dragAxes_[dragHandle_];
+                float angle = Atan2(dragStart_.CrossProduct(current).DotProduct(axis), dragStart_.DotProduct(current));
+                Quaternion q(angle, axis);
+                for(unsigned i=0; i<dragCount_; i++){
+                    DragItem& item = dragItems_[i];
+                    if(!item.node_)
+                        continue;
+                    item.node_->SetWorldRotation(q * item.worldRotation_);
+                    item.node_->SetWorldPosition(dragOrigin_ + q * (item.worldPosition_ - dragOrigin_));
+                }
+                break;
+            }
+            case GIZMO_SCALE:{
+                /// Scale factors along the gizmo axes (dragStart_ and current hold the drag distance in x)
+                float factor = Max(1.0f + (current.x_ - dragStart_.x_) / size_, MIN_SCALE_FACTOR);
+                Vector3 scale = dragHandle_==HANDLE_CENTER ? Vector3(factor, factor, factor)
+                              : dragHandle_==HANDLE_X ? Vector3(factor, 1, 1)
+                              : dragHandle_==HANDLE_Y ? Vector3(1, factor, 1) : Vector3(1, 1, factor);
+                for(unsigned i=0; i<dragCount_; i++){
+                    DragItem& item = dragItems_[i];
+                    if(!item.node_)
+                        continue;
+                    /// Node scale is applied along each node's own axes - offsets from the pivot along the gizmo's
+                    item.node_->SetScale(item.scale_ * scale);
+                    Vector3 offset = item.worldPosition_ - dragOrigin_;
+                    item.node_->SetWorldPosition(dragOrigin_
+                        + dragAxes_[0] * (offset.DotProduct(dragAxes_[0]) * scale.x_)
+                        + dragAxes_[1] * (offset.DotProduct(dragAxes_[1]) * scale.y_)
+                        + dragAxes_[2] * (offset.DotProduct(dragAxes_[2]) * scale.z_));
+                }
+                break;
+            }
+        }
+    }
+
+    /// Finish dragging, recording the changes as one undo step
+    void EndDrag(EditorHistory* history){
+        if(!dragging_)
+            return;
+        dragging_ = false;
+
+        if(history && dragCount_){
+            FindAttributeIndices(dragItems_[0].node_ ? dragItems_[0].node_.Get() : nullptr);
+            history->BeginEdit();
+            for(unsigned i=0; i<dragCount_; i++){
+                DragItem& item = dragItems_[i];
+                if(!item.node_ || positionIndex_==M_MAX_UNSIGNED)
+                    continue;
+                history->AddAttributeDelta(item.node_, positionIndex_, item.position_, item.node_->GetPosition());
+                history->AddAttributeDelta(item.node_, rotationIndex_, item.rotation_, item.node_->GetRotation());
+                history->AddAttributeDelta(item.node_, scaleIndex_,    item.scale_,    item.node_->GetScale());
+            }
+            history->EndEdit();
+        }
+        ReleaseDragItems();
+    }
+
+    /// Abandon the drag, putting everything back where it was
+    void CancelDrag(){
+        if(!dragging_)
+            return;
+        dragging_ = false;
+        for(unsigned i=0; i<dragCount_; i++){
+            DragItem& item = dragItems_[i];
+            if(!item.node_)
+                continue;
+            item.node_->SetTransform(item.position_, item.rotation_, item.scale_);
+        }
+        ReleaseDragItems();
+    }
+
+    /// Everything our appearance depends on, for the editor overlay's rebuild key
+    void AddToKey(OverlayKey& key) const {
+        key.Add(visible_);
+        if(!visible_)
+            return;
+        key.Add(mode_);
+        key.Add(dragging_ ? dragHandle_ : hover_);
+        key.Add(origin_);
+        key.Add(axes_);
+        key.Add(size_);
+    }
+
+    /// Draw the gizmo (no depth test, so it's always visible)
+    void Draw(EditorOverlay* debug){
+        if(!visible_ || !debug)
+            return;
+
+        GizmoHandle active = dragging_ ? dragHandle_ : hover_;
+        static const Color axisColors[3] = { Color::RED, Color::GREEN, Color::BLUE };
+
+        for(int i=0; i<3; i++){
+            Color color = active==i ? Color::YELLOW : axisColors[i];
+            Vector3 end = origin_ + axes_[i] * size_;
+
+            switch(mode_){
+                case GIZMO_TRANSLATE:{
+                    debug->AddLine(origin_, end, color, false);
+                    /// Arrow head
+                    const Vector3& side = axes_[(i+1)%3];
+                    Vector3 back = end - axes_[i] * (size_*0.15f);
+                    debug->AddLine(end, back + side * (size_*0.06f), color, false);
+                    debug->AddLine(end, back - side * (size_*0.06f), color, false);
+
+                    /// Plane handle (a small square between the two other axes)
+                    Color planeColor = active==HANDLE_YZ+i ? Color::YELLOW : axisColors[i];
+                    const Vector3& u = axes_[(i+1)%3];
+                    const Vector3& v = axes_[(i+2)%3];
+                    Vector3 a = origin_ + (u + v) * (size_*PLANE_MIN);
+                    Vector3 b = origin_ + u * (size_*PLANE_MAX) + v * (size_*PLANE_MIN);
+                    Vector3 c = origin_ + (u + v) * (size_*PLANE_MAX);
+                    Vector3 d = origin_ + u * (size_*PLANE_MIN) + v * (size_*PLANE_MAX);
+                    debug->AddLine(a, b, planeColor, false);
+                    debug->AddLine(b, c, planeColor, false);
+                    debug->AddLine(c, d, planeColor, false);
+                    debug->AddLine(d, a, planeColor, false);
+                    break;
+                }
+                case GIZMO_ROTATE:
+                    debug->AddCircle(origin_, axes_[i], size_, color, 48, false);
+                    break;
+
+                case GIZMO_SCALE:{
+                    debug->AddLine(origin_, end, color, false);
+                    Vector3 extent(size_*0.05f, size_*0.05f, size_*0.05f);
+                    debug->AddBoundingBox(BoundingBox(end - extent, end + extent), color, false);
+                    break;
+                }
+            }
+        }
+
+        if(mode_==GIZMO_SCALE)
+            debug->AddSphere(Sphere(origin_, size_*CENTER_RADIUS), active==HANDLE_CENTER ? Color::YELLOW : Color::WHITE, false);
+    }
+
+private:
+
+    /// Start state of one dragged node
+    struct DragItem{
+        WeakPtr<Node>   node_;
+        Vector3         worldPosition_;
+        Quaternion      worldRotation_;
+        Vector3         position_;      /// Local transform (for undo)
+        Quaternion      rotation_;
+        Vector3         scale_;
+    };
+
+    /// Handle shapes, relative to gizmo size
+    static constexpr float HIT_TOLERANCE    = 0.08f;
+    static constexpr float PLANE_MIN        = 0.25f;
+    static constexpr float PLANE_MAX        = 0.5f;
+    static constexpr float CENTER_RADIUS    = 0.12f;
+    static constexpr float MIN_SCALE_FACTOR = 0.01f;
+
+    /// Closest approach of a ray to a line (origin, unit direction):
+    /// returns false if they're parallel, otherwise the line parameter, ray distance and gap between them
+    static bool ClosestOnLine(const Ray& ray, const Vector3& origin, const Vector3& dir, float& lineParam, float& rayDistance, float& gap){
+        Vector3 w = origin - ray.origin_;
+        float b = dir.DotProduct(ray.direction_);
+        float d = dir.DotProduct(w);
+        float e = ray.direction_.DotProduct(w);
+        float denom = 1.0f - b*b;
+        if(denom < M_EPSILON)
+            return false;
+        lineParam   = (b*e - d) / denom;
+        rayDistance = (e - b*d) / denom;
+        gap = ((origin + dir*lineParam) - (ray.origin_ + ray.direction_*rayDistance)).Length();
+        return true;
+    }
+
+    /// Hit test against all handles of the current mode - returns the nearest handle hit
+    GizmoHandle HitTest(const Ray& ray) const {
+        GizmoHandle best = HANDLE_NONE;
+        float bestDistance = M_INFINITY;
+        float tolerance = size_ * HIT_TOLERANCE;
+
+        for(int i=0; i<3; i++){
+            if(mode_==GIZMO_ROTATE){
+                /// Ring: the ray must cross the ring's plane close to the circle
+                float distance = ray.HitDistance(Plane(axes_[i], origin_));
+                if(distance < bestDistance){
+                    Vector3 hit = ray.origin_ + ray.direction_ * distance;
+                    if(Abs((hit - origin_).Length() - size_) < tolerance){
+                        best = (GizmoHandle)i;
+                        bestDistance = distance;
+                    }
+                }
+                continue;
+            }
+
+            /// Axis: the ray must pass close to the axis segment
+            float lineParam, rayDistance, gap;
+            if(ClosestOnLine(ray, origin_, axes_[i], lineParam, rayDistance, gap)
+               && lineParam>=0 && lineParam<=size_ && rayDistance>0 && gap<tolerance && rayDistance<bestDistance){
+                best = (GizmoHandle)i;
+                bestDistance = rayDistance;
+            }
+
+            /// Plane square (translate only)
+            if(mode_==GIZMO_TRANSLATE){
+                float distance = ray.HitDistance(Plane(axes_[i], origin_));
+                if(distance < bestDistance){
+                    Vector3 local = ray.origin_ + ray.direction_ * distance - origin_;
+                    float u = local.DotProduct(axes_[(i+1)%3]) / size_;
+                    float v = local.DotProduct(axes_[(i+2)%3]) / size_;
+                    if(u>=PLANE_MIN && u<=PLANE_MAX && v>=PLANE_MIN && v<=PLANE_MAX){
+                        best = (GizmoHandle)(HANDLE_YZ+i);
+                        bestDistance = distance;
+                    }
+                }
+            }
+        }
+
+        /// Center sphere (scale only) wins over the axes it overlaps
+        if(mode_==GIZMO_SCALE && ray.HitDistance(Sphere(origin_, size_*CENTER_RADIUS)) < M_INFINITY)
+            best = HANDLE_CENTER;
+
+        return best;
+    }
+
+    /// Convert the ray into the quantity we're dragging, for the current mode and handle:
+    /// translate = point on the axis or plane, rotate = unit direction from the pivot in the ring's plane,
+    /// scale = drag distance (in x)
+    bool GetDragParameter(const Ray& ray, Vector3& result) const {
+        switch(mode_){
+            case GIZMO_TRANSLATE:{
+                if(dragHandle_<=HANDLE_Z){
+                    float lineParam, rayDistance, gap;
+                    if(!ClosestOnLine(ray, dragOrigin_, dragAxes_[dragHandle_], lineParam, rayDistance, gap))
+                        return false;
+                    result = dragOrigin_ + dragAxes_[dragHandle_] * lineParam;
+                    return true;
+                }
+                float distance = ray.HitDistance(Plane(dragAxes_[dragHandle_-HANDLE_YZ], dragOrigin_));
+                if(distance==M_INFINITY)
+                    return false;
+                result = ray.origin_ + ray.direction_ * distance;
+                return true;
+            }
+            case GIZMO_ROTATE:{
+                const Vector3& axis = dragAxes_[dragHandle_];
+                float distance = ray.HitDistance(Plane(axis, dragOrigin_));
+                if(distance==M_INFINITY)
+                    return false;
+                Vector3 offset = ray.origin_ + ray.direction_ * distance - dragOrigin_;
+                offset -= axis * offset.DotProduct(axis);
+                if(offset.LengthSquared() < M_EPSILON)
+                    return false;
+                result = offset.Normalized();
+                return true;
+            }
+            case GIZMO_SCALE:{
+                if(dragHandle_==HANDLE_CENTER){
+                    /// Distance from the pivot, in the plane facing the camera
+                    float distance = ray.HitDistance(Plane(-viewDirection_, dragOrigin_));
+                    if(distance==M_INFINITY)
+                        return false;
+                    result = Vector3((ray.origin_ + ray.direction_ * distance - dragOrigin_).Length(), 0, 0);
+                    return true;
+                }
+                float lineParam, rayDistance, gap;
+                if(!ClosestOnLine(ray, dragOrigin_, dragAxes_[dragHandle_], lineParam, rayDistance, gap))
+                    return false;
+                result = Vector3(lineParam, 0, 0);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Is any ancestor of the node in the drag set? One hash lookup per ancestor, so marquee selections
+    /// of thousands of nodes don't make the start of the drag quadratic
+    bool HasDraggedAncestor(Node* node) const {
+        for(Node* parent = node->GetParent(); parent; parent = parent->GetParent())
+            if(dragSet_.Contains(parent))
+                return true;
+        return false;
+    }
+
+    /// Node attribute indices for Position, Rotation and Scale (the same for every node)
+    void FindAttributeIndices(Node* node){
+        if(positionIndex_!=M_MAX_UNSIGNED || !node)
+            return;
+        const Vector<AttributeInfo>* attribs = node->GetAttributes();
+        for(unsigned i=0; attribs && i<attribs->Size(); i++){
+            const String& name = attribs->At(i).name_;
+            if(name=="Position")        positionIndex_ = i;
+            else if(name=="Rotation")   rotationIndex_ = i;
+            else if(name=="Scale")      scaleIndex_    = i;
+        }
+    }
+
+    /// Let go of the dragged nodes (the scratch storage itself is kept)
+    void ReleaseDragItems(){
+        for(unsigned i=0; i<dragCount_; i++)
+            dragItems_[i].node_.Reset();
+        dragCount_ = 0;
+        dragSet_.Clear();
+    }
+
+    GizmoMode   mode_=GIZMO_TRANSLATE;
+    bool        localSpace_=false;
+    float       screenSize_=0.15f;
+
+    /// Placement (updated every frame)
+    bool        visible_=false;
+    Vector3     origin_;
+    Vector3     axes_[3];
+    Vector3     viewDirection_;
+    float       size_=1.0f;
+    GizmoHandle hover_=HANDLE_NONE;
+
+    /// Drag state (fixed at the start of the drag)
+    bool        dragging_=false;
+    GizmoHandle dragHandle_=HANDLE_NONE;
+    Vector3     dragOrigin_;
+    Vector3     dragAxes_[3];
+    Vector3     dragStart_;
+    Vector<DragItem> dragItems_;
+    unsigned    dragCount_=0;
+    HashSet<Node*> dragSet_;    /// The nodes handed to BeginDrag (to skip those whose ancestor is dragged too)
+
+    unsigned    positionIndex_=M_MAX_UNSIGNED;
+    unsigned    rotationIndex_=M_MAX_UNSIGNED;
+    unsigned    scaleIndex_=M_MAX_UNSIGNED;
+};
@@ -0,0 +1,327 @@
+#pragma once
+
+using namespace Urho3D;
+
+/// One row of the flattened scene tree (only rows inside expanded nodes are listed)
+struct VirtualTreeRow{
+    unsigned nodeID_;
+    unsigned componentID_;      /// Zero for node rows
+    int      depth_;
+    bool     hasChildren_;      /// Node rows only: node has components or child nodes
+};
+
+/// Virtualized Scene Hierarchy view, for very large scenes.
+/// Rather than creating a UI element for every node and component in the scene,
+/// we keep a lightweight flat list of the rows that are currently "expanded",
+/// and bind just enough pooled Text rows to fill the visible area.
+/// The pooled rows live in a plain (non-hierarchy) ListView, and carry the same
+/// "NodeID" / "ComponentID" vars as the regular hierarchy items, so the editor's
+/// ItemClicked handler works with either view. Double-click a node row to expand or collapse it.
+/// The flat list is rebuilt lazily (see MarkDirty / Update), visiting only expanded nodes.
+class VirtualTreeView:public Object
+{
+    URHO3D_OBJECT(VirtualTreeView, Object);
+public:
+    VirtualTreeView(Context* context):Object(context) { }
+
+    /// Create the view inside a container: a flat ListView with a fixed pool of rows, plus our own ScrollBar
+    void Create(UIElement* container, int width, int height){
+
+        /// Discard any previous instance (ie due to reload of scene containing editor component)
+        UIElement* old = container->GetChild("VirtualContent", false);
+        if(old)
+            old->Remove();
+
+        root_ = new UIElement(context_);
+        root_->SetName("VirtualContent");
+        root_->SetLayout(LM_HORIZONTAL, 0);
+        root_->SetFixedSize(width, height);
+        container->AddChild(root_);
+
+        list_ = new ListView(context_);
+        list_->SetName("VirtualList");
+        root_->AddChild(list_);
+        list_->SetDefaultStyle( GetSubsystem<ResourceCache>()->GetResource<XMLFile>("UI/DefaultStyle.xml") );
+        list_->SetStyle("HierarchyListView");
+        list_->SetHighlightMode(HM_FOCUS);
+        list_->SetFixedSize(width-16, height);
+        /// The list never holds more rows than it can show, so it never needs to scroll itself
+        list_->SetScrollBarsAutoVisible(false);
+        list_->SetScrollBarsVisible(false, false);
+
+        scrollBar_ = new ScrollBar(context_);
+        root_->AddChild(scrollBar_);
+        scrollBar_->SetStyleAuto();
+        scrollBar_->SetOrientation(O_VERTICAL);
+        scrollBar_->SetFixedSize(16, height);
+        scrollBar_->SetRange(0.0f);
+        scrollBar_->SetValue(0.0f);
+
+        /// Create the pool of reusable rows - measure one row to find out how many will fit
+        pool_.Clear();
+        Text* probe = CreateRow();
+        probe->SetText("X");
+        int rowHeight = Max((int)Ceil(probe->GetRowHeight()), 1);
+        unsigned poolSize = Max(height / rowHeight, 1);
+        for(unsigned i=1; i<poolSize; i++)
+            CreateRow();
+
+        SubscribeToEvent(scrollBar_, E_SCROLLBARCHANGED, URHO3D_HANDLER(VirtualTreeView, HandleScrollBarChanged));
+        SubscribeToEvent(list_,      E_ITEMDOUBLECLICKED, URHO3D_HANDLER(VirtualTreeView, HandleItemDoubleClicked));
+        SubscribeToEvent(E_MOUSEWHEEL, URHO3D_HANDLER(VirtualTreeView, HandleMouseWheel));
+
+        dirty_=true;
+    }
+
+    /// Set the scene to display - the scene root starts out expanded
+    void SetScene(Scene* scene){
+        scene_ = scene;
+        expanded_.Clear();
+        if(scene)
+            expanded_.Insert(scene->GetID());
+        firstRow_=0;
+        dirty_=true;
+    }
+
+    /// Something in the scene tree has changed - we'll rebuild on the next Update
+    void MarkDirty() { dirty_=true; }
+
+    /// Rebuild the flat row list (if needed), then bind rows to the pool
+    /// Call once per frame
+    void Update(){
+        if(!dirty_ || !list_)
+            return;
+        dirty_=false;
+        RebuildRows();
+        BindRows();
+    }
+
+    /// Expand or collapse a node row
+    void ToggleExpanded(unsigned nodeID){
+        if(expanded_.Contains(nodeID))
+            expanded_.Erase(nodeID);
+        else
+            expanded_.Insert(nodeID);
+        dirty_=true;
+    }
+
+    /// Highlight the row for a node or component, expanding its ancestors and scrolling it into view
+    /// Any other nodes in the (multi-)selection set are highlighted too, if their rows happen to be listed
+    void Select(Node* node, Component* comp, const HashSet<unsigned>& otherNodeIDs = HashSet<unsigned>()){
+        selectedNodeID_      = node ? node->GetID() : 0;
+        selectedComponentID_ = comp ? comp->GetID() : 0;
+        selectedNodeIDs_     = otherNodeIDs;
+
+        if(node){
+            /// Component rows are listed inside their node, so expand the node itself too
+            for(Node* n = comp ? node : node->GetParent(); n; n = n->GetParent())
+                expanded_.Insert(n->GetID());
+        }
+
+        RebuildRows();
+        dirty_=false;
+
+        for(unsigned i=0; i<rows_.Size(); i++){
+            if(IsPrimaryRow(rows_[i])){
+                if(i<firstRow_)
+                    firstRow_=i;
+                else if(i>=firstRow_+pool_.Size())
+                    firstRow_=i+1-pool_.Size();
+                break;
+            }
+        }
+        BindRows();
+    }
+
+    ListView* GetListView() const { return list_; }
+    UIElement* GetRoot() const { return root_; }
+
+private:
+
+    Text* CreateRow(){
+        Text* t=new Text(context_);
+        list_->AddItem(t);
+        t->SetStyle("FileSelectorListText");  /// Provides selection highlighting
+        t->SetInternal(true);
+        pool_.Push(WeakPtr<Text>(t));
+        return t;
+    }
+
+    bool IsSelectedRow(const VirtualTreeRow& row) const {
+        if(row.componentID_==0 && selectedNodeIDs_.Contains(row.nodeID_))
+            return true;
+        if(selectedComponentID_)
+            return row.componentID_==selectedComponentID_;
+        return row.componentID_==0 && row.nodeID_==selectedNodeID_ && selectedNodeID_!=0;
+    }
+
+    /// The row we scroll into view when selecting
+    bool IsPrimaryRow(const VirtualTreeRow& row) const {
+        if(selectedComponentID_)
+            return row.componentID_==selectedComponentID_;
+        return row.componentID_==0 && row.nodeID_==selectedNodeID_ && selectedNodeID_!=0;
+    }
+
+    void RebuildRows(){
+        rows_.Clear();
+        if(scene_)
+            RebuildRowsRecursive(scene_, 0);
+
+        unsigned maxFirst = rows_.Size()>pool_.Size() ? rows_.Size()-pool_.Size() : 0;
+        firstRow_ = Min(firstRow_, maxFirst);
+        if(scrollBar_){
+            scrollBar_->SetRange((float)maxFirst);
+            scrollBar_->SetStepFactor(maxFirst ? 1.0f/maxFirst : 1.0f);
+        }
+    }
+
+    /// Only expanded nodes are visited, so the cost is proportional to the rows in the list,
+    /// not the size of the scene
+    void RebuildRowsRecursive(Node* node, int depth){
+        VirtualTreeRow row;
+        row.nodeID_      = node->GetID();
+        row.componentID_ = 0;
+        row.depth_       = depth;
+        row.hasChildren_ = node->GetNumComponents()>0 || node->GetNumChildren()>0;
+        rows_.Push(row);
+
+        if(!expanded_.Contains(node->GetID()))
+            return;
+
+        const Vector<SharedPtr<Component>>& ccc = node->GetComponents();
+        for(unsigned j=0; j<ccc.Size(); j++){
+            VirtualTreeRow crow;
+            crow.nodeID_      = node->GetID();
+            crow.componentID_ = ccc[j]->GetID();
+            crow.depth_       = depth+1;
+            crow.hasChildren_ = false;
+            rows_.Push(crow);
+        }
+
+        const Vector<SharedPtr<Node>>& children = node->GetChildren();
+        for(unsigned i=0; i<children.Size(); i++)
+            RebuildRowsRecursive(children[i], depth+1);
+    }
+
+    /// Copy the visible slice of the flat row list into our pooled Text rows
+    void BindRows(){
+        if(!scene_)
+            return;
+
+        selections_.Clear();
+
+        for(unsigned i=0; i<pool_.Size(); i++){
+            Text* t = pool_[i];
+            if(!t)
+                continue;
+
+            unsigned r = firstRow_+i;
+            if(r>=rows_.Size()){
+                t->SetText("");
+                t->SetVar("NodeID", Variant::EMPTY);
+                t->SetVar("ComponentID", Variant::EMPTY);
+                continue;
+            }
+
+            const VirtualTreeRow& row = rows_[r];
+            String indent(' ', row.depth_*2);
+
+            if(row.componentID_){
+                Component* comp = scene_->GetComponent(row.componentID_);
+                t->SetText(indent+"  "+(comp ? comp->GetTypeName() : String("?"))+" - "+String(row.componentID_));
+                t->SetVar("NodeID", Variant::EMPTY);
+                t->SetVar("ComponentID", row.componentID_);
+                t->SetColor(Color(0,1,0));
+            }else{
+                Node* node = scene_->GetNode(row.nodeID_);
+                String marker = !row.hasChildren_ ? "  " : expanded_.Contains(row.nodeID_) ? "- " : "+ ";
+                t->SetText(indent+marker+(node ? node->GetName() : String("?"))+" - "+String(row.nodeID_));
+                t->SetVar("NodeID", row.nodeID_);
+                t->SetVar("ComponentID", Variant::EMPTY);
+                t->SetColor(Color(0.0f,1.0f,1.0f));
+            }
+
+            if(IsSelectedRow(row))
+                selections_.Push(i);
+        }
+
+        /// Multiselect is only switched on while we have more than one row to highlight
+        list_->SetMultiselect(selections_.Size()>1);
+        if(selections_.Size())
+            list_->SetSelections(selections_);
+        else
+            list_->ClearSelection();
+
+        if(scrollBar_ && (unsigned)scrollBar_->GetValue()!=firstRow_){
+            /// Don't feed this back into HandleScrollBarChanged
+            ignoreScrollEvent_=true;
+            scrollBar_->SetValue((float)firstRow_);
+            ignoreScrollEvent_=false;
+        }
+    }
+
+    void HandleScrollBarChanged(StringHash eventType, VariantMap& eventData){
+        using namespace ScrollBarChanged;
+        if(ignoreScrollEvent_)
+            return;
+        unsigned first = (unsigned)(eventData[P_VALUE].GetFloat()+0.5f);
+        if(first!=firstRow_){
+            firstRow_=first;
+            BindRows();
+        }
+    }
+
+    void HandleMouseWheel(StringHash eventType, VariantMap& eventData){
+        using namespace MouseWheel;
+        if(!root_ || !root_->IsVisibleEffective())
+            return;
+
+        /// Only scroll when the cursor is over our view
+        UI* ui = GetSubsystem<UI>();
+        UIElement* hover = ui->GetElementAt(ui->GetCursorPosition(), false);
+        if(!hover || (hover!=root_ && !hover->IsChildOf(root_)))
+            return;
+
+        int wheel = eventData[P_WHEEL].GetInt();
+        int first = (int)firstRow_ - wheel*3;
+        int maxFirst = (int)scrollBar_->GetRange();
+        firstRow_ = (unsigned)Clamp(first, 0, maxFirst);
+        BindRows();
+    }
+
+    void HandleItemDoubleClicked(StringHash eventType, VariantMap& eventData){
+        using namespace ItemDoubleClicked;
+        UIElement* item = (UIElement*)eventData[P_ITEM].GetPtr();
+        if(!item)
+            return;
+        const Variant& v = item->GetVar("NodeID");
+        if(v.GetType()!=VAR_NONE){
+            ToggleExpanded(v.GetUInt());
+            Update();
+        }
+    }
+
+    WeakPtr<Scene>      scene_;
+    WeakPtr<UIElement>  root_;
+    WeakPtr<ListView>   list_;
+    WeakPtr<ScrollBar>  scrollBar_;
+
+    /// Flat list of expanded rows
+    Vector<VirtualTreeRow> rows_;
+    /// IDs of expanded nodes
+    HashSet<unsigned> expanded_;
+    /// Reusable UI rows
+    Vector<WeakPtr<Text>> pool_;
+    /// Index of the row bound to the top of the pool
+    unsigned firstRow_=0;
+
+    unsigned selectedNodeID_=0;
+    unsigned selectedComponentID_=0;
+    /// Other selected nodes (multi-selection)
+    HashSet<unsigned> selectedNodeIDs_;
+    /// Scratch list of highlighted pool rows
+    PODVector<unsigned> selections_;
+
+    bool dirty_=true;
+    bool ignoreScrollEvent_=false;
+};
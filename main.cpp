@@ -8,6 +8,16 @@
 
 #include "GameSceneController.h"
 #include "AgentController.h"
+#include "CrowdController.h"
+#include "PathRequestService.h"
+#include "NavMeshUpdater.h"
+#include "SceneFile.h"
+#include "AsyncSceneLoader.h"
+#include "InstancedProps.h"
+#include "BulkSpawn.h"
+#include "PrefabCache.h"
+#include "SceneBenchmark.h"
+#include "NavBuildBenchmark.h"
 
 /// BUILDTIME SWITCH: PROVIDE IN-GAME EDITOR SUPPORT?
 #define INCLUDE_GAME_EDITOR
@@ -20,6 +30,8 @@ using namespace Urho3D;
 
 /// Use TAB to hide/show custom gui
 /// Use F11/F12 to load/save both scene and ui state
+/// -- F12 also writes a binary copy of the scene (MyGameScene.bin), which F11 prefers when it is up to date
+/// -- F11 reloads the scene in the background, and swaps it in when ready
 /// Use LEFT MOUSE to Select a Candidate Object
 /// Use F1 to Take Control of Current Selected Object
 /// Use F2 to Pause Scene Updates (does not affect Editor functionality or GUI)
@@ -33,6 +45,10 @@ using namespace Urho3D;
 /// -- Use WASD to translate your Camera. Default is "relative to the Camera Facing Direction"
 /// -- Use LEFT SHIFT to translate your Character "relative to the Character Facing Direction"
 /// -- Use Mouse to orient your Camera view
+/// Launch with "-benchmark <frames>" to run a scripted scenario on MyGameScene.xml without a window,
+/// and print frame time percentiles (see SceneBenchmark.h)
+/// Launch with "-navbenchmark [workers]" to time navmesh builds of MyGameScene.xml with that many WorkQueue
+/// worker threads (run it once per thread count to compare them - see NavBuildBenchmark.h)
 
 
 class MyApp : public Application
@@ -47,6 +63,28 @@ public:
     /// Configure application prior to App Window creation
     void Setup()
     {
+        /// Headless benchmark mode?
+        const Vector<String>& arguments = GetArguments();
+        for(unsigned i=0; i<arguments.Size(); i++)
+            if(arguments[i].ToLower()=="-benchmark"){
+                benchmarkFrames_ = i+1<arguments.Size() ? ToUInt(arguments[i+1]) : 0;
+                if(!benchmarkFrames_)
+                    benchmarkFrames_ = 1000;
+            }
+            else if(arguments[i].ToLower()=="-navbenchmark"){
+                navBenchmark_ = true;
+                if(i+1<arguments.Size() && IsDigit(arguments[i+1][0]))
+                    navBenchmarkWorkers_ = (int)ToUInt(arguments[i+1]);
+            }
+        if(benchmarkFrames_ || navBenchmark_){
+            engineParameters_["Headless"]=true;
+            engineParameters_["FullScreen"]=false;
+            /// We create the worker threads ourselves (WorkQueue threads can only be created once)
+            if(navBenchmarkWorkers_>=0)
+                engineParameters_["WorkerThreads"]=false;
+            return;
+        }
+
         engineParameters_["FullScreen"]=true;
         //engineParameters_["FullScreen"]=false;
         //engineParameters_["WindowWidth"]=1280;
@@ -64,13 +102,28 @@ public:
         /// Register custom components with Urho
         GameSceneController::RegisterObject(context_);
         AgentController::RegisterObject(context_);
+        CrowdController::RegisterObject(context_);
+        PathRequestService::RegisterObject(context_);
+        NavMeshUpdater::RegisterObject(context_);
+        InstancedProps::RegisterObject(context_);
 #ifdef INCLUDE_GAME_EDITOR
         InGameEditor::RegisterObject(context_);
 #endif
+        /// Register our background scene loader as a subsystem (the editor uses it too)
+        context_->RegisterSubsystem(new AsyncSceneLoader(context_));
+        /// Prefabs are parsed once, and instantiated from binary templates (the editor uses it too)
+        context_->RegisterSubsystem(new PrefabCache(context_));
+
+        if(benchmarkFrames_ || navBenchmark_){
+            Start_Benchmark();
+            return;
+        }
+
         /// Register to receive major events of interest
         /// Note: we don't care who the "Sender" of these events is,
         /// we're interested in receiving these events from "Any Sender".
         SubscribeToEvent(E_KEYDOWN,           URHO3D_HANDLER(MyApp,HandleKeyDown));             // Keypress
+        SubscribeToEvent(E_ASYNCSCENEREADY,   URHO3D_HANDLER(MyApp,HandleAsyncSceneReady));     // Background scene load completed
 //        SubscribeToEvent(E_UPDATE,            URHO3D_HANDLER(MyApp,HandleFrameUpdate));         // Frame Update
 //        SubscribeToEvent(E_POSTRENDERUPDATE,  URHO3D_HANDLER(MyApp,HandlePostRenderUpdate));    // Post-Render Update
 //        SubscribeToEvent(E_UIMOUSECLICK,      URHO3D_HANDLER(MyApp,HandleControlClicked));      // User clicked a UI element
@@ -96,6 +149,49 @@ private:
 
 
 
+    /// Load our scene without UI, viewport or editor (there is no window), and run the benchmark on it
+    void Start_Benchmark(){
+        /// Run flat out - no frame limiting (headless, we never have input focus)
+        engine_->SetMaxFps(0);
+        engine_->SetMaxInactiveFps(0);
+
+        gameScene_ = new Scene(context_);
+        if(!LoadSceneFile(gameScene_, GetSubsystem<FileSystem>()->GetProgramDir()+mySceneFilePath_)){
+            ErrorExit("Benchmark could not load "+mySceneFilePath_);
+            return;
+        }
+
+        /// Navmesh build benchmark - runs to completion right here
+        if(navBenchmark_){
+            if(navBenchmarkWorkers_>0)
+                GetSubsystem<WorkQueue>()->CreateThreads((unsigned)navBenchmarkWorkers_);
+            SharedPtr<NavBuildBenchmark> navBenchmark(new NavBuildBenchmark(context_));
+            navBenchmark->Run(gameScene_);
+            engine_->Exit();
+            return;
+        }
+
+        /// The game controller is driven by live input - the benchmark drives the camera itself
+        auto* controller = gameScene_->GetComponent<GameSceneController>();
+        if(controller)
+            controller->SetEnabled(false);
+#ifdef INCLUDE_GAME_EDITOR
+        /// Nor can the editor run without a window (we script its operations instead)
+        gameScene_->RemoveComponent<InGameEditor>();
+#endif
+
+        gameScene_->GetOrCreateComponent<CrowdController>();
+        gameScene_->GetOrCreateComponent<PathRequestService>();
+        gameScene_->GetOrCreateComponent<NavMeshUpdater>();
+
+        cameraNode_ = gameScene_->GetChild("Camera Node");
+        if(!cameraNode_)
+            cameraNode_ = gameScene_->CreateChild("Camera Node");
+
+        benchmark_ = new SceneBenchmark(context_);
+        benchmark_->Start(gameScene_, cameraNode_, benchmarkFrames_);
+    }
+
     /// Set up our 2D GUI
     void Setup_UI(){
         /// Obtain access to the root element of the UI system
@@ -192,15 +288,15 @@ private:
         /// We'll give our new scene a name, just because we can
         gameScene_->SetName(mySceneFilePath_);
 
-        /// Attempt to load scene content from xml file
-        if(LoadSceneFromXML(mySceneFilePath_))
-            URHO3D_LOGINFO("Loaded GameScene from XML!");
+        /// Attempt to load scene content from file (binary copy if its up to date, otherwise xml)
+        if(LoadSceneFromFile(GetSceneLoadPath()))
+            URHO3D_LOGINFO("Loaded GameScene from file!");
 
         /// If that fails, we'll use code to populate our scene
         /// and then we'll dump the scene content to xml file for future reference
         else{
             PopulateGameScene();
-            SaveSceneToXML(mySceneFilePath_);
+            SaveScene();
             URHO3D_LOGINFO("Populated new GameScene and saved to XML!");
         }
 
@@ -211,13 +307,8 @@ private:
 #endif
     }
 
-    /// Save gameScene to XML file
-    bool SaveSceneToXML(String filepath){
-        bool success=false;
-
-        /// Any scene node or component can have custom data associated with it
-        /// We'll abuse this to "Save" our camera behaviour type
-
+    /// Save gameScene to file - the format (xml or binary) is chosen by file extension
+    bool SaveSceneToFile(String filepath){
 
         /// absolute filepaths are good
         /// We'll ask Urho for the full path to its resource folder (ie Bin)
@@ -225,32 +316,46 @@ private:
         String fullpath=GetSubsystem<FileSystem>()->GetProgramDir()+filepath ;
 
         // Dump our Scene to disk, so we can use it to load from in future
-        Urho3D::File file(context_, fullpath, FILE_WRITE);
-        if(file.IsOpen()){
-            success = gameScene_->SaveXML(file);
-            file.Close();
+        return SaveSceneFile(gameScene_, fullpath);
+    }
+
+    /// Load gameScene from file - the format (xml or binary) is chosen by file extension
+    bool LoadSceneFromFile(String filepath){
+        /// Open a SceneFile for Loading
+        String fullpath=GetSubsystem<FileSystem>()->GetProgramDir ()+filepath ;
+
+        bool success = LoadSceneFile(gameScene_, fullpath);
+        if(success){
+            /// Repair weak pointers
+            OnSceneReloaded();
         }
         return success;
     }
 
-    /// Load gameScene from XML file
-    bool LoadSceneFromXML(String filepath){
-        bool success = false;
-        /// Open a SceneFile for Loading
+    /// Load a new gameScene from file in the background - rendering and input carry on as normal,
+    /// and the new scene replaces the current one when it's ready (see HandleAsyncSceneReady)
+    bool LoadSceneFromFileAsync(String filepath){
         String fullpath=GetSubsystem<FileSystem>()->GetProgramDir ()+filepath ;
+        return GetSubsystem<AsyncSceneLoader>()->Load(fullpath);
+    }
 
-        Urho3D::File file(context_, fullpath, FILE_READ);
-        if(file.IsOpen())
-        {
-            success = gameScene_->LoadXML(file);
-            if(success){
-                /// Repair weak pointers
-                OnSceneReloaded();
-            }
+    /// Save our scene as xml (the "source" file), plus its binary twin if enabled
+    bool SaveScene(){
+        bool success = SaveSceneToFile(mySceneFilePath_);
+        if(success && useBinarySceneCache_)
+            success = SaveSceneToFile(GetSceneTwinPath(mySceneFilePath_));
+        return success;
+    }
 
-            file.Close();
+    /// Decide which file to (re)load our scene from:
+    /// the binary twin is much faster to load, but we only trust it when its not older than the xml
+    String GetSceneLoadPath(){
+        if(useBinarySceneCache_){
+            FileSystem* fs = GetSubsystem<FileSystem>();
+            if(HasFreshBinaryTwin(fs, fs->GetProgramDir()+mySceneFilePath_))
+                return GetSceneTwinPath(mySceneFilePath_);
         }
-        return success;
+        return mySceneFilePath_;
     }
 
     /// Save UI content to XML file
@@ -337,6 +442,11 @@ private:
         /// Locate our gamecontroller component in the scene (or create one if not found)
         gameController_ = gameScene_->GetOrCreateComponent<GameSceneController>();
 
+        /// Older scene files predate the crowd controller, path request service and navmesh updater
+        gameScene_->GetOrCreateComponent<CrowdController>();
+        gameScene_->GetOrCreateComponent<PathRequestService>();
+        gameScene_->GetOrCreateComponent<NavMeshUpdater>();
+
         #ifdef INCLUDE_GAME_EDITOR
         gameScene_->GetOrCreateComponent<InGameEditor>();
         #endif
@@ -548,6 +658,38 @@ private:
         return boxNode;
     }
 
+    /// Utility Method: Scatter lots of small boxes over a square area, as instanced props.
+    /// The area is split into chunks (one InstancedProps node each), so the Octree can still cull the field piece by piece
+    Node* CreateProps(ResourceCache* cache, const String& NodeName, unsigned Count, float HalfSize, unsigned ChunksPerSide){
+        Node* propsNode = gameScene_->CreateChild(NodeName);
+        float chunkSize = HalfSize * 2.0f / ChunksPerSide;
+
+        Vector<InstancedProps*> chunks;
+        for(unsigned z=0; z<ChunksPerSide; z++)
+            for(unsigned x=0; x<ChunksPerSide; x++){
+                Node* chunkNode = propsNode->CreateChild(NodeName+String(x)+"_"+String(z));
+                chunkNode->SetPosition(Vector3(-HalfSize + (x+0.5f)*chunkSize, 0.0f, -HalfSize + (z+0.5f)*chunkSize));
+                auto* props = chunkNode->CreateComponent<InstancedProps>();
+                props->SetModel(cache->GetResource<Model>("Models/Box.mdl"));
+                props->SetMaterial(cache->GetResource<Material>("Materials/MyFirstMaterial.xml"));
+                props->ReserveInstances(Count / (ChunksPerSide*ChunksPerSide) + 1);
+                chunks.Push(props);
+            }
+
+        for(unsigned i=0; i<Count; i++){
+            Vector3 pos(Random(-HalfSize, HalfSize), 0.0f, Random(-HalfSize, HalfSize));
+            unsigned x = Min((unsigned)((pos.x_ + HalfSize) / chunkSize), ChunksPerSide-1);
+            unsigned z = Min((unsigned)((pos.z_ + HalfSize) / chunkSize), ChunksPerSide-1);
+            InstancedProps* props = chunks[z*ChunksPerSide + x];
+
+            /// Sit each prop on top of the floor
+            float size = Random(0.05f, 0.25f);
+            pos.y_ = 0.5f + size*0.5f;
+            props->AddInstance(pos - props->GetNode()->GetPosition(), Quaternion(0.0f, Random(360.0f), 0.0f), Vector3(size, size, size));
+        }
+        return propsNode;
+    }
+
     /// Create and initialize a Camera node and component
     Node* CreateCamera(const Vector3& Position){
 
@@ -615,6 +757,15 @@ private:
 
         gameScene_->CreateComponent<Navigable>();
 
+        /// One controller for all crowd agents (see CrowdController.h)
+        gameScene_->CreateComponent<CrowdController>();
+
+        /// Move orders go through the path request service, which shares paths between agents (see PathRequestService.h)
+        auto* pathRequests = gameScene_->CreateComponent<PathRequestService>();
+
+        /// Rebuild navmesh tiles when the geometry they were built from is moved, added or removed (see NavMeshUpdater.h)
+        gameScene_->CreateComponent<NavMeshUpdater>();
+
         /// Next we'll create a Camera for rendering a 3D scene ...
         cameraNode_ = CreateCamera( Vector3(20,20,-20));
 
@@ -654,12 +805,21 @@ private:
 
         auto* box1 = CreateBox(cache, "Box1",Vector3(0.0f, 1.0f, 0.0f), Quaternion(0.0f,45.0f,0.0f), Vector3::ONE);
 
-        /// Create a bunch of Boxes
+        /// Create a bunch of Boxes - in bulk (see BulkSpawn.h), rather than one CreateBox at a time
+        HiresTimer spawnTimer;
+        BulkSpawn boxes;
+        boxes.Reserve(62);
         for(int i=2;i<64;i++)
         {
             float HalfSize = Random(0.25f, 3.0f);
-            CreateBox(cache, "Box"+String(i),Vector3(Random(-50,+50), HalfSize+0.5f, Random(-50,+50)),Quaternion(0.0f,Random(360),0.0f), Vector3(HalfSize*2,HalfSize*2,HalfSize*2));
+            boxes.Add("Box"+String(i),Vector3(Random(-50,+50), HalfSize+0.5f, Random(-50,+50)),Quaternion(0.0f,Random(360),0.0f), Vector3(HalfSize*2,HalfSize*2,HalfSize*2), HalfSize*2>3.5f);
         }
+        boxes.Spawn(gameScene_, cache->GetResource<Model>("Models/Box.mdl"), cache->GetResource<Material>("Materials/MyFirstMaterial.xml"));
+        /// Note: this is only logged - it has not been compared against spawning the same boxes with CreateBox
+        URHO3D_LOGINFO("Spawned "+String(boxes.GetNumItems())+" boxes in "+String(spawnTimer.GetUSec(false))+" usec");
+
+        /// Scatter a field of small props - these are instanced, so they cost no nodes of their own
+        CreateProps(cache, "Props", 20000, 50.0f, 8);
 
         /// Create one more box, this one will act as our "character"
         auto*box = CreateBox(cache, "CharacterBox",Vector3(5.0f, 1.0f, 5.0f),Quaternion(0.0f,45.0f,0.0f), Vector3::ONE);
@@ -670,14 +830,16 @@ private:
 //        box->SetParent(characterNode_);
 
 
-        bool result = navmesh->Build();
+        /// Build the navmesh - its tiles are built in parallel, on the WorkQueue threads (see NavTileBuilder.h)
+        SharedPtr<NavTileBuilder> navBuilder(new NavTileBuilder(context_));
+        bool result = navBuilder->BuildAll(navmesh);
 
         auto* agent = box0->CreateComponent<CrowdAgent>();
         agent->SetHeight(2.0f);
         agent->SetMaxSpeed(3.0f);
         agent->SetMaxAccel(5.0f);
 
-        agent->SetTargetPosition(Vector3(1000,0,1000));//  navmesh->FindNearestPoint(agent->GetPosition()+Vector3::FORWARD));
+        pathRequests->RequestMove(agent, Vector3(1000,0,1000));//  navmesh->FindNearestPoint(agent->GetPosition()+Vector3::FORWARD));
 
     }
 
@@ -871,6 +1033,23 @@ blabel1=new Text(context_);
 
     }
 */
+    /// A scene has finished loading in the background - swap it in
+    /// Note: this might have been requested by the InGameEditor, not just by us
+    void HandleAsyncSceneReady(StringHash eventType, VariantMap& eventData){
+        using namespace AsyncSceneReady;
+        Scene* scene = static_cast<Scene*>(eventData[P_SCENE].GetPtr());
+        if(!scene)
+            return;
+
+        /// Our old scene is destroyed here, unless someone else is holding on to it
+        gameScene_ = scene;
+        gameScene_->RegisterVar("Camera Behaviour");
+        gameScene_->RegisterVar("Character Node");
+
+        /// Repair weak pointers
+        OnSceneReloaded();
+    }
+
     /// KeyPress event handler
     void HandleKeyDown(StringHash eventType, VariantMap& eventData){
         using namespace KeyDown;
@@ -933,8 +1112,8 @@ blabel1=new Text(context_);
         // LOAD SCENE AND UI STATE FROM XML
         else if(key==KEY_F11){
 
-            /// Reload Scene
-            LoadSceneFromXML(mySceneFilePath_);
+            /// Reload Scene (in the background)
+            LoadSceneFromFileAsync(GetSceneLoadPath());
 
             /// Reload UI
             LoadGUIFromXML(myGUILayoutFilePath_);
@@ -944,7 +1123,7 @@ blabel1=new Text(context_);
         // SAVE SCENE AND UI STATE TO XML FILE
         else if(key==KEY_F12)
         {
-            SaveSceneToXML(mySceneFilePath_);
+            SaveScene();
             SaveGUIToXML(myGUILayoutFilePath_);
         }
     }
@@ -1025,6 +1204,10 @@ blabel1=new Text(context_);
     /// The default filepath for loading/saving scene content
     String mySceneFilePath_ = "MyGameScene.xml";
 
+    /// Whether we also save / prefer to load a binary copy of our scene file ("MyGameScene.bin")
+    /// Reloading binary scene data skips all the xml parsing
+    bool useBinarySceneCache_ = true;
+
     /// The default filepath for loading/saving UI content
     String myGUILayoutFilePath_ = "MyGUI.xml";
 
@@ -1057,6 +1240,13 @@ blabel1=new Text(context_);
 
     WeakPtr<GameSceneController> gameController_;
 
+    /// Benchmark mode: number of frames to run (zero when running normally)
+    unsigned benchmarkFrames_=0;
+    SharedPtr<SceneBenchmark> benchmark_;
+    /// Navmesh build benchmark mode, and its worker thread count (-1 = the engine's default)
+    bool navBenchmark_=false;
+    int  navBenchmarkWorkers_=-1;
+
 };
 
 URHO3D_DEFINE_APPLICATION_MAIN(MyApp)